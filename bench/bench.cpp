@@ -0,0 +1,271 @@
+/* throughput benchmark of the compiler phases on synthetic templates, prints one JSON object per
+ * scenario and line so that the results of releases can be compared by scripts */
+#include "cinja.h"
+#include "lexer.h"
+#include "parser.h"
+#include "validate.h"
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#ifndef CINJA_VERSION
+#define CINJA_VERSION "unknown"
+#endif
+
+/* the parameters of a synthetic template */
+struct shape {
+    std::string name;
+    size_t size;        /* approximate size in bytes */
+    unsigned depth;     /* nesting depth of if and for statements */
+    unsigned macros;    /* number of macros that are called from the body */
+    unsigned expr_len;  /* number of operands of every expression */
+    double static_ratio; /* fraction of the template that is plain content */
+    bool unswitch = false; /* every loop starts with a branch on the context */
+};
+
+class generator
+{
+  private:
+    const shape &shape_;
+    std::mt19937 rng_;
+    std::ostringstream o_;
+
+    unsigned pick(unsigned n) { return std::uniform_int_distribution<unsigned>(0, n - 1)(rng_); }
+
+    void expr(const std::string &var)
+    {
+        o_ << var << ".v0";
+        for (unsigned i = 1; i < shape_.expr_len; ++i)
+            o_ << " " << "+-*"[pick(3)] << " " << (pick(2) ? var + ".v" + std::to_string(i) : "2");
+    }
+
+    void content(size_t bytes)
+    {
+        static const char *words[] = {"lorem", "ipsum", "dolor", "sit", "amet", "<p>", "</p>",
+                                      "<span class=\"x\">", "</span>", "\n    "};
+
+        for (size_t n = 0; n < bytes;) {
+            std::string word = words[pick(sizeof(words) / sizeof(*words))];
+            o_ << word << " ";
+            n += word.size() + 1;
+        }
+    }
+
+    void dynamic(const std::string &var)
+    {
+        if (shape_.macros > 0 && pick(4) == 0) {
+            o_ << "{{ m" << pick(shape_.macros) << "(" << var << ".name, ";
+            expr(var);
+            o_ << ") }}";
+        } else {
+            o_ << "{{ ";
+            expr(var);
+            o_ << " }}";
+        }
+    }
+
+    /* emits a chunk of about the given size nested into the remaining depth */
+    void chunk(size_t bytes, unsigned depth, const std::string &var)
+    {
+        if (depth > 0) {
+            std::string inner = "i" + std::to_string(depth);
+
+            if (shape_.unswitch) {
+                o_ << "{% for " << inner << " in " << var << ".items %}{% if ctx.c" << depth
+                   << " %}";
+                content(16);
+                o_ << "{% endif %}";
+                chunk(bytes, depth - 1, inner);
+                o_ << "{% endfor %}";
+            } else if (pick(2)) {
+                o_ << "{% for " << inner << " in " << var << ".items if " << inner << ".n > 1 %}";
+                chunk(bytes, depth - 1, inner);
+                o_ << "{% endfor %}";
+            } else {
+                o_ << "{% if " << var << ".ok and not " << var << ".hidden %}";
+                chunk(bytes, depth - 1, var);
+                o_ << "{% else %}";
+                content(16);
+                o_ << "{% endif %}";
+            }
+            return;
+        }
+
+        const size_t start = o_.tellp();
+        while (static_cast<size_t>(o_.tellp()) - start < bytes) {
+            if (pick(1000) < shape_.static_ratio * 1000)
+                content(64);
+            else
+                dynamic(var);
+        }
+    }
+
+  public:
+    generator(const shape &s, unsigned seed) : shape_(s), rng_(seed) {}
+
+    std::string run()
+    {
+        for (unsigned i = 0; i < shape_.macros; ++i) {
+            o_ << "{% macro m" << i << "(name, value) %}<b>{{ name }}</b>{{ value * 2 }}"
+               << "{% endmacro %}\n";
+        }
+
+        const size_t chunk_size = 4096;
+        while (static_cast<size_t>(o_.tellp()) < shape_.size)
+            chunk(chunk_size, shape_.depth, "ctx");
+
+        return o_.str();
+    }
+};
+
+/* returns the fastest of the given number of runs in seconds */
+static double measure(unsigned repeats, const std::function<void()> &run)
+{
+    double best = 1e300;
+
+    for (unsigned i = 0; i < repeats; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+        best = std::min(best, time.count());
+    }
+
+    return best;
+}
+
+static void bench(const shape &s, unsigned repeats, const cinja::options &options, std::ostream &o)
+{
+    const std::string content = generator(s, 42).run();
+    const tk_store tokens = tokenize_template(content);
+    const double mb = content.size() / 1e6;
+
+    double lex = measure(repeats, [&]() { tokenize_template(content); });
+
+    double parse = measure(repeats, [&]() {
+        Arena arena;
+        tk_store store(tokens);
+        tk_iterator it(store);
+        parse_template(it, arena);
+    });
+
+    /* the later phases need a fresh tree for every run, which is not part of their time */
+    auto phase = [&](const std::function<void(TemplateNode &, Arena &)> &run) {
+        double best = 1e300;
+
+        for (unsigned i = 0; i < repeats; ++i) {
+            Arena arena;
+            tk_store store(tokens);
+            tk_iterator it(store);
+            nptr<TemplateNode> root = parse_template(it, arena);
+
+            best = std::min(best, measure(1, [&]() { run(*root, arena); }));
+        }
+
+        return best;
+    };
+
+    double validate = phase([](TemplateNode &root, Arena &arena) { root.validate(); });
+
+    double gen = phase([&](TemplateNode &root, Arena &arena) {
+        SymbolTable syms(arena);
+        std::ostringstream out;
+        std::vector<cinja::diagnostic> diagnostics;
+        cinja::transform(root, arena, syms, options, diagnostics);
+        root.print(out);
+    });
+
+    o << "{\"version\": \"" << CINJA_VERSION << "\", \"scenario\": \"" << s.name
+      << "\", \"optimize\": " << (options.optimize ? "true" : "false")
+      << ", \"bytes\": " << content.size() << ", \"tokens\": " << tokens.size()
+      << ", \"phases\": {";
+
+    const std::pair<const char *, double> phases[] = {
+        {"lex", lex}, {"parse", parse}, {"validate", validate}, {"gen", gen}};
+
+    for (const auto &p : phases) {
+        o << (p.first == phases[0].first ? "" : ", ") << "\"" << p.first
+          << "\": {\"seconds\": " << p.second << ", \"mb_per_s\": " << mb / p.second
+          << ", \"tokens_per_s\": " << tokens.size() / p.second << "}";
+    }
+
+    o << "}}" << std::endl;
+}
+
+static void print_help(std::ostream &ostream, const std::string &prog)
+{
+    ostream << "Usage:\n\t" << prog << " FLAGS [SCENARIO...]\n";
+    ostream << "FLAGS:\n";
+    ostream << "\t-r n    Report the fastest of n runs of every phase (default 5)\n";
+    ostream << "\t-s f    Scale the size of the templates by f (default 1)\n";
+    ostream << "\t-n      Generate the code without the optimizations\n";
+    ostream << "\t-l      List the scenarios\n";
+    ostream << "\t-h      Display this message\n";
+}
+
+int main(int argc, char *argv[])
+{
+    using namespace std;
+
+    /* name, size, depth, macros, expression length, static ratio, unswitch */
+    vector<shape> shapes{
+        {"small", 16 << 10, 2, 4, 3, 0.7},     {"large", 16 << 20, 2, 8, 3, 0.7},
+        {"deep", 4 << 20, 24, 0, 2, 0.5},      {"macros", 4 << 20, 1, 256, 3, 0.5},
+        {"long_expr", 4 << 20, 1, 0, 64, 0.2}, {"static", 16 << 20, 0, 0, 1, 0.98},
+        {"dynamic", 4 << 20, 1, 8, 4, 0.05},
+        /* pathological shapes, the time per byte should stay that of the others */
+        {"no_tags", 16 << 20, 0, 0, 1, 1},     {"nested", 4 << 20, 500, 0, 2, 0.5},
+        {"chain", 4 << 20, 1, 0, 500, 0.2},   {"unswitch", 1 << 20, 16, 0, 2, 0.5, true}};
+
+    unsigned repeats = 5;
+    double scale = 1;
+    cinja::options options;
+
+    try {
+        int param;
+        while ((param = getopt(argc, argv, "hlnr:s:")) != -1) {
+            switch (param) {
+            case '?':
+                print_help(cerr, argv[0]);
+                return EXIT_FAILURE;
+            case 'h':
+                print_help(cout, argv[0]);
+                return EXIT_SUCCESS;
+            case 'l':
+                for (const auto &s : shapes)
+                    cout << s.name << "\n";
+                return EXIT_SUCCESS;
+            case 'r':
+                repeats = max(1ul, stoul(optarg));
+                break;
+            case 's':
+                scale = stod(optarg);
+                break;
+            case 'n':
+                options.optimize = false;
+                break;
+            }
+        }
+
+        vector<string> names(argv + optind, argv + argc);
+
+        for (auto s : shapes) {
+            if (!names.empty() && find(names.begin(), names.end(), s.name) == names.end())
+                continue;
+
+            s.size = max<size_t>(1, s.size * scale);
+            bench(s, repeats, options, cout);
+        }
+
+    } catch (const exception &e) {
+        cerr << "Error: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -52,20 +52,17 @@ namespace macros {
 		o << u8R"content"""(
     <ol>
 
+    
     )content"""";
 		{
 			auto vsym_label = std::string("Deactivate");
-			o << u8R"content"""(
-    )content"""";
 			if (!(vsym_active)) {
 				o << u8R"content"""(
-        )content"""";
+        
+    )content"""";
 				{
 					vsym_label = std::string("Activate");
-					o << u8R"content"""(
-    )content"""";
 				}
-			} else {
 			}
 			o << u8R"content"""(
 
@@ -90,11 +87,11 @@ namespace macros {
     )content"""";
 				}
 			}
-			o << u8R"content"""(
+		}
+		o << u8R"content"""(
 
     </ol>
 )content"""";
-		}
 	}
 }
 
@@ -126,81 +123,148 @@ void render_template(O &o, T0 vsym_history, T1 vsym_users) {
 
 <body>
 
-)content"""";
-	o << u8R"content"""(
 
-)content"""";
-	o << u8R"content"""(
 
 
-)content"""";
-	o << u8R"content"""(
+
+
+
 
 <h3>Example</h3>
 <form action="">
-    )content"""";
-	macros::input(o, std::string("a"), std::string(""), std::string("text"));
-	o << u8R"content"""(
-    )content"""";
-	macros::input(o, std::string("b"), std::string(""), std::string("text"));
-	o << u8R"content"""(
-    )content"""";
-	macros::input(o, std::string("c"), std::string("Ok"), std::string("submit"));
-	o << u8R"content"""(
+    
+    <input type="text" name="a" value="">
+
+    
+    <input type="text" name="b" value="">
+
+    
+    <input type="submit" name="c" value="Ok">
+
 </form>
 
 <ol>
     )content"""";
 	for (const auto& vsym_entry : vsym_history) {
-		if (true) {
-			o << u8R"content"""(
-        )content"""";
-			{
-				auto vsym_a = (vsym_entry.first);
-				o << u8R"content"""(
-        )content"""";
-				{
-					auto vsym_b = (vsym_entry.second);
-					o << u8R"content"""(
+		o << u8R"content"""(
+        
+        
 
         <li>
             <p>)content"""";
-					o << vsym_a;
-					o << u8R"content"""( ⋅ )content"""";
-					o << vsym_b;
-					o << u8R"content"""( = )content"""";
-					o << (vsym_a * vsym_b);
-					o << u8R"content"""(</p>
+		{
+			auto vsym_a = (vsym_entry.first);
+			{
+				auto vsym_b = (vsym_entry.second);
+				o << vsym_a;
+				o << u8R"content"""( ⋅ )content"""";
+				o << vsym_b;
+				o << u8R"content"""( = )content"""";
+				o << (vsym_a * vsym_b);
+				o << u8R"content"""(</p>
             <p>)content"""";
-					o << vsym_a;
-					o << u8R"content"""(² + )content"""";
-					o << vsym_b;
-					o << u8R"content"""(² = )content"""";
-					o << ((vsym_a * vsym_a) + (vsym_b * vsym_b));
-					o << u8R"content"""(</p>
+				o << vsym_a;
+				o << u8R"content"""(² + )content"""";
+				o << vsym_b;
+				o << u8R"content"""(² = )content"""";
+				o << ((vsym_a * vsym_a) + (vsym_b * vsym_b));
+				o << u8R"content"""(</p>
             <p>)content"""";
-					macros::fact(o, vsym_a);
-					o << u8R"content"""(</p>
+				macros::fact(o, vsym_a);
+			}
+		}
+		o << u8R"content"""(</p>
         </li>
 
     )content"""";
-				}
-			}
-		}
 	}
 	o << u8R"content"""(
 </ol>
 
 <form action="">
     <h3>Active Users</h3>
+    
+    <ol>
+
+    
+    
+
+    )content"""";
+	{
+		auto inl4_vsym_users = vsym_users;
+		{
+			auto vsym_label = std::string("Deactivate");
+			for (const auto& vsym_user : inl4_vsym_users) {
+				if (((vsym_user.active) == true)) {
+					o << u8R"content"""(
+        <li>
+            <span>)content"""";
+					o << (vsym_user.firstname);
+					o << u8R"content"""( )content"""";
+					o << (vsym_user.lastname);
+					o << u8R"content"""(</span>
+            <button type="submit" value=")content"""";
+					o << (vsym_user.id);
+					o << u8R"content"""(" name=")content"""";
+					o << vsym_label;
+					o << u8R"content"""("> )content"""";
+					o << vsym_label;
+					o << u8R"content"""( </button>
+        </li>
     )content"""";
-	macros::print_users(o, vsym_users, true);
+				}
+			}
+		}
+	}
 	o << u8R"content"""(
 
+    </ol>
+
+
     <h3>Inactive Users</h3>
+    
+    <ol>
+
+    
+    
+        
+    )content"""";
+	{
+		auto inl5_vsym_users = vsym_users;
+		{
+			auto vsym_label = std::string("Deactivate");
+			{
+				vsym_label = std::string("Activate");
+			}
+			o << u8R"content"""(
+
     )content"""";
-	macros::print_users(o, vsym_users, false);
+			for (const auto& vsym_user : inl5_vsym_users) {
+				if (((vsym_user.active) == false)) {
+					o << u8R"content"""(
+        <li>
+            <span>)content"""";
+					o << (vsym_user.firstname);
+					o << u8R"content"""( )content"""";
+					o << (vsym_user.lastname);
+					o << u8R"content"""(</span>
+            <button type="submit" value=")content"""";
+					o << (vsym_user.id);
+					o << u8R"content"""(" name=")content"""";
+					o << vsym_label;
+					o << u8R"content"""("> )content"""";
+					o << vsym_label;
+					o << u8R"content"""( </button>
+        </li>
+    )content"""";
+				}
+			}
+		}
+	}
 	o << u8R"content"""(
+
+    </ol>
+
 </form>
 
 </body>
@@ -0,0 +1,37 @@
+#include "arena.h"
+#include <cstring>
+
+void *Arena::allocate(size_t size, size_t align)
+{
+    size_t pad = -reinterpret_cast<uintptr_t>(pos_) & (align - 1);
+
+    if (pad + size > left_) {
+        /* large objects get a block of their own so the current block can still be used */
+        if (size > BLOCK_SIZE / 4) {
+            blocks_.emplace_back(new char[size + align]);
+            char *data = blocks_.back().get();
+            return data + (-reinterpret_cast<uintptr_t>(data) & (align - 1));
+        }
+
+        blocks_.emplace_back(new char[BLOCK_SIZE]);
+        pos_ = blocks_.back().get();
+        left_ = BLOCK_SIZE;
+        pad = -reinterpret_cast<uintptr_t>(pos_) & (align - 1);
+    }
+
+    void *result = pos_ + pad;
+    pos_ += pad + size;
+    left_ -= pad + size;
+    return result;
+}
+
+std::string_view Arena::intern(std::string_view str)
+{
+    auto it = strings_.find(str);
+    if (it != strings_.end())
+        return *it;
+
+    char *data = static_cast<char *>(allocate(str.size(), 1));
+    std::memcpy(data, str.data(), str.size());
+    return *strings_.emplace(data, str.size()).first;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <memory>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <unordered_set>
+#include <vector>
+
+/* an immutable array that lives in an arena */
+template <typename T> class nlist
+{
+  private:
+    T *data_ = nullptr;
+    size_t size_ = 0;
+
+  public:
+    nlist() = default;
+    nlist(T *data, size_t size) : data_(data), size_(size) {}
+
+    T *begin() const { return data_; }
+    T *end() const { return data_ + size_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    T &front() const { return data_[0]; }
+    T &back() const { return data_[size_ - 1]; }
+    T &operator[](size_t i) const { return data_[i]; }
+};
+
+/* a bump allocator for objects that are all freed at once when the arena is destroyed, their
+ * destructors are never run so only trivially destructible types may be created in it */
+class Arena
+{
+  private:
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char *pos_ = nullptr;
+    size_t left_ = 0;
+    std::unordered_set<std::string_view> strings_;
+
+    static const size_t BLOCK_SIZE = 1 << 16;
+
+  public:
+    Arena() = default;
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    void *allocate(size_t size, size_t align);
+
+    template <typename T, typename... Args> T *make(Args &&... args)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects are not destroyed");
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    template <typename T> nlist<T> list(const std::vector<T> &values)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects are not destroyed");
+
+        if (values.empty())
+            return nlist<T>();
+
+        T *data = static_cast<T *>(allocate(sizeof(T) * values.size(), alignof(T)));
+        std::uninitialized_copy(values.begin(), values.end(), data);
+        return nlist<T>(data, values.size());
+    }
+
+    /* returns a copy of the string that lives in the arena, equal strings share one copy */
+    std::string_view intern(std::string_view str);
+};
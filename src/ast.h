@@ -1,10 +1,17 @@
 #pragma once
-#include <memory>
-#include <ostream>
+#include "arena.h"
+#include "symtab.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <map>
+#include <optional>
 #include <set>
+#include <ostream>
 #include <string>
+#include <string_view>
 #include <typeindex>
-#include <unordered_set>
+#include <variant>
 #include <vector>
 
 enum class BinOp {
@@ -29,54 +36,186 @@ enum class BinOp {
 
 enum class UnOp { NEG, NOT };
 
-/* base class for all ast nodes */
+typedef std::map<std::type_index, size_t> NodeCounts;
+
+/* a value of the template language that is known at compile time, strings refer to literals and
+ * numbers that the generated code writes as int literals are ints, so that the evaluation follows
+ * the C++ arithmetic of the generated code */
+typedef std::variant<bool, int, double, std::string_view> Value;
+
+/* whether a number is written as an int literal, the lowest int has no literal of its own */
+inline bool is_int(double value)
+{
+    return std::trunc(value) == value && value > INT_MIN && value <= INT_MAX;
+}
+typedef std::map<sym_id, Value> Values;
+
+/* the value of the operator applied to the values as in the generated code, if it has a literal */
+std::optional<Value> apply(BinOp op, const Value &lhs, const Value &rhs);
+
+/* appends the value the way the generated code writes it to a default stream, returns false for
+ * strings with escapes, which are left to the C++ compiler */
+bool write_value(const Value &value, std::string &out);
+
+/* base class for all ast nodes, nodes are allocated in an arena and never destroyed individually */
 class Node
 {
   public:
-    typedef std::unordered_multiset<std::string> mset;
-    typedef std::set<std::string> set;
     typedef std::ostream ostr;
 
-    ostr &print(ostr &o, unsigned lvl = 0) const
-    {
-        set fsym;
-        mset bsym;
-        return print(o, fsym, bsym, lvl);
-    }
-
-    virtual ostr &print(ostr &o, set &fsym, mset &bsym, unsigned lvl = 0) const = 0;
+    virtual ostr &print(ostr &o, unsigned lvl = 0) const = 0;
     virtual void validate() const = 0;
-    virtual ~Node() {}
+
+    /* interns the identifiers and determines the scope of every symbol */
+    virtual void resolve(SymbolTable &syms) = 0;
+
+    /* adds this node and all of its descendants to the counts of their classes */
+    virtual void count(NodeCounts &counts) const = 0;
+};
+
+template <typename N = Node> using nptr = N *;
+
+class ExprNode;
+class StmtListNode;
+class IdNode;
+class MacroNode;
+
+/* the state of constant folding, the values of the variables that are set to literals */
+struct Folding {
+    Arena &arena;
+    const SymbolTable &syms;
+    std::map<sym_id, nptr<ExprNode>> constants;
 };
 
-template <typename N = Node> using nptr = std::unique_ptr<N>;
+/* the state of inlining, the macros that may be inlined and the fresh names of the arguments of
+ * the one being copied, which are numbered per caller so that its code does not depend on others */
+struct Inlining {
+    Arena &arena;
+    SymbolTable &syms;
+    std::map<sym_id, nptr<MacroNode>> macros;
+    std::map<sym_id, nptr<IdNode>> renames;
+    std::string_view caller;
+    unsigned sites = 0;
+};
+
+/* the state of the compile-time evaluation, the values of the bound symbols and the part of the
+ * budget of the current expansion that is left, and of the outermost loop that is unrolled */
+struct Evaluation {
+    Arena &arena;
+    SymbolTable &syms;
+    std::map<sym_id, nptr<MacroNode>> macros;
+    Values values;
+    size_t budget;
+    size_t left = 0;
+    unsigned depth = 0;
+    size_t room = 0;
+    bool unrolling = false;
+};
 
 /* base class for all statements */
 class StmtNode : public Node
 {
   public:
+    /* merges the runs of static output in the bodies of the statement */
+    virtual void coalesce(Arena &arena) {}
+
+    /* folds the constant expressions of the statement, returns the statements that replace it if
+     * parts of it are never executed, or null if it stays */
+    virtual nptr<StmtListNode> fold(Folding &f) { return nullptr; }
+
+    /* moves the conditions that do not change between iterations out of the loops in the
+     * statement, returns the statement that takes its place */
+    virtual nptr<StmtNode> hoist(Arena &arena, const SymbolTable &syms) { return this; }
+
+    /* replaces the calls of small macros by their bodies, returns the statements that replace
+     * this one, or null if it stays */
+    virtual nptr<StmtListNode> inline_calls(Inlining &in) { return nullptr; }
+
+    /* returns a deep copy that refers to the renamed symbols, statements that are never changed in
+     * place are shared */
+    virtual nptr<StmtNode> clone(Inlining &in) { return this; }
+
+    /* adds the symbols of the macros the statement calls */
+    virtual void callees(std::set<sym_id> &ids) const {}
+
+    /* appends the output of the statement to out, returns false if it depends on values that are
+     * not known or does not fit the budget */
+    virtual bool evaluate(Evaluation &ev, std::string &out) const { return false; }
+
+    /* replaces the calls and loops whose inputs are known by their output, or unrolls the loops
+     * over literal lists, returns the statements that replace this one, or null if it stays */
+    virtual nptr<StmtListNode> expand(Evaluation &ev) { return nullptr; }
 };
 
 /* base class for all expressions */
 class ExprNode : public Node
 {
+  private:
+    mutable std::optional<std::type_index> type_;
+
+  protected:
+    /* computes the type from the (cached) types of the children */
+    virtual std::type_index infer_type() const = 0;
+
   public:
     virtual long begin_line() const = 0;
     virtual long end_line() const = 0;
-    virtual std::type_index type() const = 0;
     virtual void validate() const = 0;
+
+    bool typed() const { return type_.has_value(); }
+
+    /* returns a literal if the expression is constant, otherwise folds the operands in place */
+    virtual nptr<ExprNode> fold(Folding &f) { return this; }
+
+    /* whether the value is the same in every iteration of a loop over var */
+    virtual bool invariant(const SymbolTable &syms, sym_id var) const { return true; }
+
+    /* returns a deep copy that refers to the renamed symbols, leaves are shared */
+    virtual nptr<ExprNode> clone(Inlining &in) { return this; }
+
+    /* returns the value if it only depends on the given values */
+    virtual std::optional<Value> evaluate(const Values &values) const { return std::nullopt; }
+
+    /* the type is inferred once, bottom-up, and cached in the node */
+    std::type_index type() const
+    {
+        if (!type_)
+            type_ = infer_type();
+
+        return *type_;
+    }
 };
 
 class StmtListNode : public Node
 {
   public:
-    std::vector<nptr<StmtNode>> stmts;
+    nlist<nptr<StmtNode>> stmts;
 
     StmtListNode() = default;
-    StmtListNode(std::vector<nptr<StmtNode>> &&stmts) : stmts(std::move(stmts)) {}
+    StmtListNode(nlist<nptr<StmtNode>> stmts) : stmts(stmts) {}
 
     virtual void validate() const override;
-    virtual ostr &print(ostr &o, set &fsym, mset &bsym, unsigned lvl = 0) const override;
+    virtual void resolve(SymbolTable &syms) override;
+    virtual void count(NodeCounts &counts) const override;
+    virtual ostr &print(ostr &o, unsigned lvl = 0) const override;
+
+    /* replaces every run of content and interpolated literals by a single content node */
+    void coalesce(Arena &arena);
+
+    /* folds the statements and puts the ones that replace them in their place */
+    void fold(Folding &f);
+
+    void hoist(Arena &arena, const SymbolTable &syms);
+
+    void inline_calls(Inlining &in);
+    nptr<StmtListNode> clone(Inlining &in) const;
+    void callees(std::set<sym_id> &ids) const;
+
+    /* the number of nodes in the statements and their descendants */
+    size_t nodes() const;
+
+    bool evaluate(Evaluation &ev, std::string &out) const;
+    void expand(Evaluation &ev);
 };
 
 class FieldNode : public ExprNode
@@ -85,36 +224,33 @@ class FieldNode : public ExprNode
     long line_no;
 
   public:
-    std::string name;
+    std::string_view name;
 
-    FieldNode(const std::string &name, long line_no) : line_no(line_no), name(name) {}
+    FieldNode(std::string_view name, long line_no) : line_no(line_no), name(name) {}
 
-    virtual ostr &print(ostr &o, set &fsym, mset &bsym, unsigned lvl = 0) const override;
-    virtual std::type_index type() const override;
+    virtual ostr &print(ostr &o, unsigned lvl = 0) const override;
+    virtual std::type_index infer_type() const override;
     virtual long begin_line() const override { return line_no; }
     virtual long end_line() const override { return line_no; }
     virtual void validate() const override {}
+    virtual void resolve(SymbolTable &syms) override {}
+    virtual void count(NodeCounts &counts) const override;
 };
 
-/* a node that represents an identifier */
+/* a node that represents an identifier, the names are interned in the arena */
 class IdNode : public ExprNode
 {
   private:
     long line_no;
 
   public:
-    std::string name;
-    std::string nspace;
+    std::string_view name;
+    std::string_view nspace;
     bool binding;
+    sym_id sym = SymbolTable::NONE;
 
-    IdNode(const std::string &name, long line_no) : line_no(line_no), name(name) {}
-
-    IdNode(const std::string &prefix, const std::string &name, long line_no, bool binding = false)
-        : line_no(line_no), name(prefix + "_" + name), binding(binding)
-    {
-    }
-
-    IdNode(const std::string &name, long line_no, const std::string &nspace, bool binding = false)
+    IdNode(std::string_view name, long line_no, std::string_view nspace = std::string_view(),
+           bool binding = false)
         : line_no(line_no), name(name), nspace(nspace), binding(binding)
     {
     }
@@ -122,16 +258,22 @@ class IdNode : public ExprNode
     std::string full_name() const
     {
         if (nspace.empty())
-            return name;
+            return std::string(name);
 
-        return nspace + "::" + name;
+        return std::string(nspace) + "::" + std::string(name);
     }
 
-    virtual ostr &print(ostr &o, set &fsym, mset &bsym, unsigned lvl = 0) const override;
-    virtual std::type_index type() const override;
+    virtual ostr &print(ostr &o, unsigned lvl = 0) const override;
+    virtual std::type_index infer_type() const override;
     virtual long begin_line() const override { return line_no; }
     virtual long end_line() const override { return line_no; }
     virtual void validate() const override {}
+    virtual void resolve(SymbolTable &syms) override;
+    virtual void count(NodeCounts &counts) const override;
+    virtual nptr<ExprNode> fold(Folding &f) override;
+    virtual bool invariant(const SymbolTable &syms, sym_id var) const override;
+    virtual nptr<ExprNode> clone(Inlining &in) override;
+    virtual std::optional<Value> evaluate(const Values &values) const override;
 };
 
 class ForNode : public StmtNode
@@ -142,8 +284,21 @@ class ForNode : public StmtNode
     nptr<ExprNode> filter;
     nptr<StmtListNode> body;
 
-    virtual ostr &print(ostr &o, set &fsym, mset &bsym, unsigned lvl = 0) const override;
+    /* whether the loop or one in its body is a copy of an unswitched loop */
+    bool unswitched = false;
+
+    virtual ostr &print(ostr &o, unsigned lvl = 0) const override;
     virtual void validate() const override;
+    virtual void resolve(SymbolTable &syms) override;
+    virtual void count(NodeCounts &counts) const override;
+    virtual void coalesce(Arena &arena) override;
+    virtual nptr<StmtListNode> fold(Folding &f) override;
+    virtual nptr<StmtNode> hoist(Arena &arena, const SymbolTable &syms) override;
+    virtual nptr<StmtListNode> inline_calls(Inlining &in) override;
+    virtual nptr<StmtNode> clone(Inlining &in) override;
+    virtual void callees(std::set<sym_id> &ids) const override;
+    virtual bool evaluate(Evaluation &ev, std::string &out) const override;
+    virtual nptr<StmtListNode> expand(Evaluation &ev) override;
 };
 
 class SetNode : public StmtNode
@@ -153,17 +308,34 @@ class SetNode : public StmtNode
     nptr<ExprNode> value;
     nptr<StmtListNode> body;
 
-    virtual ostr &print(ostr &o, set &fsym, mset &bsym, unsigned lvl = 0) const override;
+    /* whether the variable is introduced here or an outer one is assigned to */
+    bool declares = false;
+
+    virtual ostr &print(ostr &o, unsigned lvl = 0) const override;
     virtual void validate() const override;
+    virtual void resolve(SymbolTable &syms) override;
+    virtual void count(NodeCounts &counts) const override;
+    virtual void coalesce(Arena &arena) override;
+    virtual nptr<StmtListNode> fold(Folding &f) override;
+    virtual nptr<StmtNode> hoist(Arena &arena, const SymbolTable &syms) override;
+    virtual nptr<StmtListNode> inline_calls(Inlining &in) override;
+    virtual nptr<StmtNode> clone(Inlining &in) override;
+    virtual void callees(std::set<sym_id> &ids) const override;
+    virtual bool evaluate(Evaluation &ev, std::string &out) const override;
+    virtual nptr<StmtListNode> expand(Evaluation &ev) override;
 };
 
 class ContentNode : public StmtNode
 {
   public:
-    std::string content;
+    /* refers to the template source */
+    std::string_view content;
 
-    virtual ostr &print(ostr &o, set &fsym, mset &bsym, unsigned lvl = 0) const override;
+    virtual ostr &print(ostr &o, unsigned lvl = 0) const override;
     virtual void validate() const override {}
+    virtual void resolve(SymbolTable &syms) override {}
+    virtual void count(NodeCounts &counts) const override;
+    virtual bool evaluate(Evaluation &ev, std::string &out) const override;
 };
 
 class ListNode : public ExprNode
@@ -172,15 +344,20 @@ class ListNode : public ExprNode
     long line_no;
 
   public:
-    std::vector<nptr<ExprNode>> values;
+    nlist<nptr<ExprNode>> values;
 
-    ListNode(std::vector<nptr<ExprNode>> &&values) : values(std::move(values)) {}
+    ListNode(nlist<nptr<ExprNode>> values) : values(values) {}
 
-    virtual ostr &print(ostr &o, set &fsym, mset &bsym, unsigned lvl = 0) const override;
+    virtual ostr &print(ostr &o, unsigned lvl = 0) const override;
     virtual void validate() const override;
+    virtual void resolve(SymbolTable &syms) override;
+    virtual void count(NodeCounts &counts) const override;
+    virtual nptr<ExprNode> fold(Folding &f) override;
+    virtual bool invariant(const SymbolTable &syms, sym_id var) const override;
+    virtual nptr<ExprNode> clone(Inlining &in) override;
     virtual long begin_line() const override { return line_no; }
     virtual long end_line() const override { return line_no; }
-    virtual std::type_index type() const override;
+    virtual std::type_index infer_type() const override;
 };
 
 class IfNode : public StmtNode
@@ -190,8 +367,18 @@ class IfNode : public StmtNode
     nptr<StmtListNode> body;
     nptr<StmtListNode> elze;
 
-    virtual ostr &print(ostr &o, set &fsym, mset &bsym, unsigned lvl = 0) const override;
+    virtual ostr &print(ostr &o, unsigned lvl = 0) const override;
     virtual void validate() const override;
+    virtual void resolve(SymbolTable &syms) override;
+    virtual void count(NodeCounts &counts) const override;
+    virtual void coalesce(Arena &arena) override;
+    virtual nptr<StmtListNode> fold(Folding &f) override;
+    virtual nptr<StmtNode> hoist(Arena &arena, const SymbolTable &syms) override;
+    virtual nptr<StmtListNode> inline_calls(Inlining &in) override;
+    virtual nptr<StmtNode> clone(Inlining &in) override;
+    virtual void callees(std::set<sym_id> &ids) const override;
+    virtual bool evaluate(Evaluation &ev, std::string &out) const override;
+    virtual nptr<StmtListNode> expand(Evaluation &ev) override;
 };
 
 class VarNode : public StmtNode
@@ -199,8 +386,13 @@ class VarNode : public StmtNode
   public:
     nptr<ExprNode> expr;
 
-    virtual ostr &print(ostr &o, set &fsym, mset &bsym, unsigned lvl = 0) const override;
+    virtual ostr &print(ostr &o, unsigned lvl = 0) const override;
     virtual void validate() const override;
+    virtual void resolve(SymbolTable &syms) override;
+    virtual void count(NodeCounts &counts) const override;
+    virtual nptr<StmtListNode> fold(Folding &f) override;
+    virtual nptr<StmtNode> clone(Inlining &in) override;
+    virtual bool evaluate(Evaluation &ev, std::string &out) const override;
 };
 
 template <typename T> class LiteralNode : public ExprNode
@@ -212,15 +404,23 @@ template <typename T> class LiteralNode : public ExprNode
     LiteralNode(const T &value, long line_no) : line_no(line_no), value(value) {}
     T value;
 
-    virtual ostr &print(ostr &o, set &fsym, mset &bsym, unsigned lvl = 0) const override
-    {
-        return o << value;
-    }
+    virtual ostr &print(ostr &o, unsigned lvl = 0) const override { return o << value; }
 
     virtual long begin_line() const override { return line_no; }
     virtual long end_line() const override { return line_no; }
-    virtual std::type_index type() const override { return typeid(T); }
+    virtual std::type_index infer_type() const override { return typeid(T); }
     virtual void validate() const override {}
+    virtual void resolve(SymbolTable &syms) override {}
+    virtual void count(NodeCounts &counts) const override { ++counts[typeid(*this)]; }
+    virtual std::optional<Value> evaluate(const Values &values) const override
+    {
+        if constexpr (std::is_same_v<T, double>) {
+            if (is_int(value))
+                return Value(static_cast<int>(value));
+        }
+
+        return Value(value);
+    }
 };
 
 class UnOpNode : public ExprNode
@@ -229,11 +429,17 @@ class UnOpNode : public ExprNode
     UnOp op;
     nptr<ExprNode> arg;
 
-    virtual ostr &print(ostr &o, set &fsym, mset &bsym, unsigned lvl = 0) const override;
+    virtual ostr &print(ostr &o, unsigned lvl = 0) const override;
     virtual long begin_line() const override { return arg->begin_line(); }
     virtual long end_line() const override { return arg->end_line(); }
     virtual void validate() const override;
-    virtual std::type_index type() const override;
+    virtual void resolve(SymbolTable &syms) override;
+    virtual void count(NodeCounts &counts) const override;
+    virtual nptr<ExprNode> fold(Folding &f) override;
+    virtual bool invariant(const SymbolTable &syms, sym_id var) const override;
+    virtual nptr<ExprNode> clone(Inlining &in) override;
+    virtual std::optional<Value> evaluate(const Values &values) const override;
+    virtual std::type_index infer_type() const override;
 
   private:
     void match_type(std::type_index const &arg, std::type_index const &type) const;
@@ -246,25 +452,59 @@ class BinOpNode : public ExprNode
     nptr<ExprNode> lhs;
     nptr<ExprNode> rhs;
 
-    virtual ostr &print(ostr &o, set &fsym, mset &bsym, unsigned lvl = 0) const override;
-    virtual long begin_line() const override { return lhs->begin_line(); }
+    virtual ostr &print(ostr &o, unsigned lvl = 0) const override;
+    virtual long begin_line() const override
+    {
+        auto op = this;
+        while (auto inner = dynamic_cast<const BinOpNode *>(op->lhs))
+            op = inner;
+
+        return op->lhs->begin_line();
+    }
     virtual long end_line() const override { return rhs->end_line(); }
     virtual void validate() const override;
-    virtual std::type_index type() const override;
+    virtual void resolve(SymbolTable &syms) override;
+    virtual void count(NodeCounts &counts) const override;
+    virtual nptr<ExprNode> fold(Folding &f) override;
+    virtual bool invariant(const SymbolTable &syms, sym_id var) const override;
+    virtual nptr<ExprNode> clone(Inlining &in) override;
+    virtual std::optional<Value> evaluate(const Values &values) const override;
+    virtual std::type_index infer_type() const override;
 
   private:
     void match_types(std::type_index const &lhs, std::type_index const &rhs,
                      std::type_index const &type) const;
+    nptr<ExprNode> fold_operator(Folding &f, std::optional<Value> &value);
 };
 
+/* the operators of a chain like a + b + c from the innermost one to the given one, a chain is as
+ * long as the template allows, so the passes walk it in a loop instead of recursing into it */
+template <typename T> std::vector<T *> chain(T *op)
+{
+    std::vector<T *> ops{op};
+    while (auto inner = dynamic_cast<T *>(ops.back()->lhs))
+        ops.push_back(inner);
+
+    std::reverse(ops.begin(), ops.end());
+    return ops;
+}
+
 class CallNode : public StmtNode
 {
   public:
     nptr<IdNode> id;
-    std::vector<nptr<ExprNode>> args;
+    nlist<nptr<ExprNode>> args;
 
     virtual void validate() const override;
-    virtual ostr &print(ostr &o, set &fsym, mset &bsym, unsigned lvl) const override;
+    virtual void resolve(SymbolTable &syms) override;
+    virtual void count(NodeCounts &counts) const override;
+    virtual nptr<StmtListNode> fold(Folding &f) override;
+    virtual nptr<StmtListNode> inline_calls(Inlining &in) override;
+    virtual nptr<StmtNode> clone(Inlining &in) override;
+    virtual void callees(std::set<sym_id> &ids) const override;
+    virtual bool evaluate(Evaluation &ev, std::string &out) const override;
+    virtual nptr<StmtListNode> expand(Evaluation &ev) override;
+    virtual ostr &print(ostr &o, unsigned lvl = 0) const override;
 };
 
 class ArgumentNode : public Node
@@ -274,18 +514,54 @@ class ArgumentNode : public Node
     nptr<ExprNode> dflt;
 
     virtual void validate() const override;
-    virtual ostr &print(ostr &o, set &fsym, mset &bsym, unsigned lvl = 0) const override;
+    virtual void resolve(SymbolTable &syms) override;
+    virtual void count(NodeCounts &counts) const override;
+    virtual ostr &print(ostr &o, unsigned lvl = 0) const override;
 };
 
 class MacroNode : public Node
 {
   public:
     nptr<IdNode> id;
-    std::vector<nptr<ArgumentNode>> args;
+    nlist<nptr<ArgumentNode>> args;
     nptr<StmtListNode> body;
 
+    /* whether the body uses no symbols besides the arguments */
+    bool closed = false;
+
     virtual void validate() const override;
-    virtual ostr &print(ostr &o, set &fsym, mset &bsym, unsigned lvl = 0) const override;
+    virtual void resolve(SymbolTable &syms) override;
+    virtual void count(NodeCounts &counts) const override;
+    virtual ostr &print(ostr &o, unsigned lvl = 0) const override;
+
+    void coalesce(Arena &arena);
+    void fold(Arena &arena, const SymbolTable &syms);
+    void hoist(Arena &arena, const SymbolTable &syms);
+};
+
+/* the macros of a template that is imported or included, they live in a namespace named by the
+ * hash of its source so that they are defined once in a program however many templates use them */
+class ImportNode : public Node
+{
+  public:
+    std::string_view nspace;
+    nlist<nptr<MacroNode>> macros;
+
+    virtual void validate() const override;
+    virtual void resolve(SymbolTable &syms) override;
+    virtual void count(NodeCounts &counts) const override;
+    virtual ostr &print(ostr &o, unsigned lvl = 0) const override;
+
+    void coalesce(Arena &arena);
+    void fold(Arena &arena, const SymbolTable &syms);
+    void hoist(Arena &arena, const SymbolTable &syms);
+};
+
+/* the concrete types a template is compiled for, the headers in includes have to declare them */
+struct Instantiation {
+    std::string sink;
+    std::vector<std::string> types; /* in the order of TemplateNode::params */
+    std::vector<std::string> includes;
 };
 
 /* root node of the parsed template */
@@ -293,9 +569,40 @@ class TemplateNode : public Node
 {
   public:
     nptr<StmtListNode> body;
-    std::vector<nptr<MacroNode>> macros;
+    nlist<nptr<MacroNode>> macros;
+    nlist<nptr<ImportNode>> imports;
+
+    /* the free symbols of the body in order of their names */
+    nlist<std::string_view> params;
 
     TemplateNode() = default;
     virtual void validate() const override;
-    virtual ostr &print(ostr &o, set &fsym, mset &bsym, unsigned lvl = 0) const override;
+    virtual void resolve(SymbolTable &syms) override;
+    virtual void count(NodeCounts &counts) const override;
+    virtual ostr &print(ostr &o, unsigned lvl = 0) const override;
+
+    /* merges the static output of the body and the macros into as few writes as possible */
+    void coalesce(Arena &arena);
+
+    /* folds the constant expressions and removes the statements that are never executed */
+    void fold(Arena &arena, const SymbolTable &syms);
+
+    /* unswitches the loops on the conditions that do not depend on the iteration */
+    void hoist(Arena &arena, const SymbolTable &syms);
+
+    /* replaces the calls of small macros that are not recursive by copies of their bodies */
+    void inline_calls(Arena &arena, SymbolTable &syms);
+
+    /* evaluates the calls and loops with known inputs at compile time, each of them may take up to
+     * budget nodes and bytes of output */
+    void expand(Arena &arena, SymbolTable &syms, size_t budget);
+
+    /* prints a header that declares render_template and an extern instantiation of it */
+    ostr &print_declaration(ostr &o, const Instantiation &inst) const;
+
+    /* prints the definitions and the explicit instantiation that goes with the declaration */
+    ostr &print_instantiation(ostr &o, const Instantiation &inst) const;
+
+  private:
+    ostr &print_definitions(ostr &o, unsigned lvl) const;
 };
@@ -0,0 +1,106 @@
+#include "cache.h"
+#include "source.h"
+#include <cerrno>
+#include <cstdio>
+#include <iomanip>
+#include <sstream>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+#ifndef CINJA_VERSION
+#define CINJA_VERSION "unknown"
+#endif
+
+uint64_t fnv1a(std::string_view data, uint64_t hash)
+{
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 0x100000001b3;
+    }
+
+    return hash;
+}
+
+static std::system_error errno_error(const std::string &what)
+{
+    return std::system_error(errno, std::generic_category(), what);
+}
+
+/* returns whether the file at path exists and has exactly the given content */
+static bool has_content(const std::string &path, std::string_view data)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) < 0 || !S_ISREG(st.st_mode) ||
+        static_cast<size_t>(st.st_size) != data.size())
+        return false;
+
+    try {
+        return source(path).data() == data;
+    } catch (const std::system_error &) {
+        return false;
+    }
+}
+
+bool write_if_changed(const std::string &path, std::string_view data)
+{
+    if (has_content(path, data))
+        return false;
+
+    std::string tmp = path + ".XXXXXX";
+    int fd = mkstemp(&tmp[0]);
+    if (fd < 0)
+        throw errno_error(path);
+
+    /* mkstemp creates the file only readable by the owner */
+    fchmod(fd, 0644);
+
+    for (size_t pos = 0; pos < data.size();) {
+        ssize_t n = write(fd, data.data() + pos, data.size() - pos);
+
+        if (n < 0 && errno != EINTR) {
+            auto e = errno_error(path);
+            close(fd);
+            unlink(tmp.c_str());
+            throw e;
+        }
+
+        pos += n > 0 ? n : 0;
+    }
+
+    if (close(fd) < 0 || rename(tmp.c_str(), path.c_str()) < 0) {
+        auto e = errno_error(path);
+        unlink(tmp.c_str());
+        throw e;
+    }
+
+    return true;
+}
+
+std::string Cache::path(uint64_t key) const
+{
+    std::ostringstream s;
+    s << dir_ << "/" << std::hex << std::setw(16) << std::setfill('0') << key << ".h";
+    return s.str();
+}
+
+uint64_t Cache::key(std::string_view content, std::string_view options)
+{
+    /* the parts are separated by a zero byte so they cannot run into each other */
+    uint64_t hash = fnv1a(std::string_view(CINJA_VERSION, sizeof(CINJA_VERSION)));
+    hash = fnv1a(options, hash);
+    hash = fnv1a(std::string_view("", 1), hash);
+    return fnv1a(content, hash);
+}
+
+bool Cache::lookup(uint64_t key, std::string &code) const
+{
+    try {
+        code = source(path(key)).data();
+        return true;
+    } catch (const std::system_error &) {
+        return false;
+    }
+}
+
+void Cache::store(uint64_t key, std::string_view code) const { write_if_changed(path(key), code); }
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/* 64 bit FNV-1a hash, the hash of a previous part can be passed in to continue it */
+uint64_t fnv1a(std::string_view data, uint64_t hash = 0xcbf29ce484222325);
+
+/* writes the data to a temporary file next to the path and renames it, so readers never see a
+ * partially written file, nothing is written if the file already has this content, returns
+ * whether the file was written */
+bool write_if_changed(const std::string &path, std::string_view data);
+
+/* a directory of generated code keyed by a hash of everything that determines the code, entries
+ * are written atomically so several compilers can share a cache */
+class Cache
+{
+  private:
+    std::string dir_;
+
+    std::string path(uint64_t key) const;
+
+  public:
+    explicit Cache(const std::string &dir) : dir_(dir) {}
+
+    /* the key of a template covers the compiler version and the options that change the code */
+    static uint64_t key(std::string_view content, std::string_view options);
+
+    /* returns whether there is an entry for the key and reads it into code */
+    bool lookup(uint64_t key, std::string &code) const;
+    void store(uint64_t key, std::string_view code) const;
+};
@@ -0,0 +1,188 @@
+#include "cinja.h"
+#include "lexer.h"
+#include "parser.h"
+#include "stats.h"
+#include "validate.h"
+#include <list>
+#include <sstream>
+
+namespace cinja
+{
+/* maps the parameter types to the parameters of the template in their order */
+static Instantiation instantiation(const TemplateNode &root, const options &options,
+                                   std::vector<diagnostic> &diagnostics)
+{
+    Instantiation inst{options.sink, {}, options.includes};
+    std::map<std::string, std::string> unused;
+
+    for (const auto &param : options.param_types)
+        unused[symbol_name(param.first)] = param.first;
+
+    for (const auto &param : root.params) {
+        auto it = unused.find(std::string(param));
+        if (it == unused.end()) {
+            std::string var = variable_name(param);
+            throw CompileError("no type given for the template variable '" + var + "'", 0);
+        }
+
+        inst.types.push_back(options.param_types.at(it->second));
+        unused.erase(it);
+    }
+
+    for (const auto &param : unused) {
+        diagnostics.push_back(
+            {severity::WARNING, 0, "the template has no variable '" + param.second + "'"});
+    }
+
+    return inst;
+}
+
+/* generates the code into out, or the split code into out and impl if a sink is given */
+static void generate(const TemplateNode &root, std::ostream &out, std::ostream *impl,
+                     const options &options, std::vector<diagnostic> &diagnostics)
+{
+    if (options.sink.empty()) {
+        root.print(out) << std::endl;
+        return;
+    }
+
+    if (!impl)
+        throw std::logic_error("the split code can only be returned in the result");
+
+    auto inst = instantiation(root, options, diagnostics);
+    root.print_declaration(out, inst);
+    root.print_instantiation(*impl, inst);
+}
+
+void transform(TemplateNode &root, Arena &arena, SymbolTable &syms, const options &options,
+               std::vector<diagnostic> &diagnostics)
+{
+    Stats *stats = options.stats;
+
+    root.resolve(syms);
+    diagnostics.insert(diagnostics.end(), syms.warnings.begin(), syms.warnings.end());
+    if (stats)
+        stats->phase("resolve");
+
+    if (options.optimize) {
+        root.inline_calls(arena, syms);
+        if (stats)
+            stats->phase("inline");
+
+        root.fold(arena, syms);
+        if (stats)
+            stats->phase("fold");
+
+        root.expand(arena, syms, options.eval_budget);
+        if (stats)
+            stats->phase("expand");
+
+        root.hoist(arena, syms);
+        if (stats)
+            stats->phase("hoist");
+    }
+
+    root.coalesce(arena);
+    if (stats)
+        stats->phase("coalesce");
+}
+
+static void run(std::string_view source, std::ostream &out, std::ostream *impl,
+                const options &options, std::vector<diagnostic> &diagnostics)
+{
+    Stats *stats = options.stats;
+
+    if (stats) {
+        stats->phase("read");
+        stats->source_size = source.size();
+    }
+
+    /* lexing on several threads needs all tokens in memory, otherwise they are pulled from the
+     * source as the parser needs them, the statistics need all tokens to time the lexer on its
+     * own */
+    std::unique_ptr<tk_source> tokens;
+    if (options.threads > 1 || stats) {
+        auto store = new tk_store(tokenize_template(source, options.threads));
+        tokens.reset(store);
+
+        if (stats) {
+            stats->phase("lex");
+            stats->count_tokens(*store);
+        }
+    } else {
+        tokens.reset(new tk_stream(source));
+    }
+
+    /* the sources of the extended templates, which the tree refers to */
+    std::list<std::string> loaded;
+    Loader load;
+    if (options.load) {
+        load = [&](std::string_view name) -> std::string_view {
+            loaded.push_back(options.load(std::string(name)));
+            return loaded.back();
+        };
+    }
+
+    Arena arena;
+    tk_iterator it(*tokens);
+    nptr<TemplateNode> root = parse_template(it, arena, load);
+    if (stats)
+        stats->phase("parse");
+
+    root->validate();
+    if (stats)
+        stats->phase("validate");
+
+    SymbolTable syms(arena);
+    transform(*root, arena, syms, options, diagnostics);
+
+    if (!stats) {
+        generate(*root, out, impl, options, diagnostics);
+        return;
+    }
+
+    counting_buf buf(out.rdbuf());
+    std::ostream counted(&buf);
+    counted.exceptions(out.exceptions());
+    generate(*root, counted, impl, options, diagnostics);
+
+    stats->phase("print");
+    stats->code_size = buf.count() + (impl ? static_cast<size_t>(impl->tellp()) : 0);
+    stats->count_nodes(*root);
+}
+
+/* collects the errors of a compilation in the diagnostics */
+template <typename F> static result guard(F run)
+{
+    result res;
+
+    try {
+        run(res.diagnostics);
+    } catch (const CompileError &e) {
+        res.diagnostics.push_back({severity::ERROR, e.line(), e.what()});
+    } catch (const std::exception &e) {
+        res.diagnostics.push_back({severity::ERROR, 0, e.what()});
+    }
+
+    return res;
+}
+
+result compile(std::string_view source, std::ostream &out, const options &options)
+{
+    return guard([&](auto &diagnostics) { run(source, out, nullptr, options, diagnostics); });
+}
+
+result compile(std::string_view source, const options &options)
+{
+    std::ostringstream out;
+    std::ostringstream impl;
+    result res = guard([&](auto &diagnostics) { run(source, out, &impl, options, diagnostics); });
+
+    if (res.ok()) {
+        res.code = out.str();
+        res.impl = impl.str();
+    }
+
+    return res;
+}
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "diagnostic.h"
+#include <functional>
+#include <map>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class Arena;
+class Stats;
+class SymbolTable;
+class TemplateNode;
+
+namespace cinja
+{
+struct options {
+    /* large templates are lexed on up to this many threads */
+    unsigned threads = 1;
+
+    /* collects the time and memory of every phase if set */
+    Stats *stats = nullptr;
+
+    /* with a sink the code is split into a header that declares render_template for the sink
+     * and the parameter types, which are given by the names of the template variables, and an
+     * implementation that instantiates it once, the includes have to declare the types */
+    std::string sink;
+    std::map<std::string, std::string> param_types;
+    std::vector<std::string> includes;
+
+    /* returns the source of a template that is extended by its name, a template can only extend
+     * others if it is set */
+    std::function<std::string(const std::string &name)> load;
+
+    /* inlines, folds, expands and hoists the tree before the code is generated, the rendered
+     * output is the same either way */
+    bool optimize = true;
+
+    /* macro calls and loops whose inputs are known are evaluated at compile time if that takes
+     * at most this many steps and bytes of output each, 0 leaves them all to the generated code */
+    size_t eval_budget = 4096;
+};
+
+struct result {
+    /* the generated code, empty if it was written to a stream or the compilation failed */
+    std::string code;
+
+    /* the explicit instantiation that goes with the code if a sink was given */
+    std::string impl;
+    std::vector<diagnostic> diagnostics;
+
+    bool ok() const
+    {
+        for (const auto &d : diagnostics) {
+            if (d.level == severity::ERROR)
+                return false;
+        }
+
+        return true;
+    }
+};
+
+/* resolves, optimizes and coalesces a validated tree like a compilation does before the code is
+ * generated, the warnings are added to diagnostics and errors are thrown */
+void transform(TemplateNode &root, Arena &arena, SymbolTable &syms, const options &options,
+               std::vector<diagnostic> &diagnostics);
+
+/* compiles a template to C++ code, errors are reported as diagnostics and never thrown */
+result compile(std::string_view source, const options &options = cinja::options());
+
+/* writes the code to out while it is generated, the output is incomplete if the compilation fails,
+ * the output cannot be split this way */
+result compile(std::string_view source, std::ostream &out,
+               const options &options = cinja::options());
+}
@@ -0,0 +1,127 @@
+#include "ast.h"
+#include <algorithm>
+
+/* appends the text a statement always writes to text, returns false if it depends on the input */
+static bool static_text(const StmtNode *stmt, std::string &text)
+{
+    if (auto content = dynamic_cast<const ContentNode *>(stmt)) {
+        text += content->content;
+        return true;
+    }
+
+    auto var = dynamic_cast<const VarNode *>(stmt);
+    if (!var)
+        return false;
+
+    /* only the literals themselves, the fold pass decides which expressions are constant */
+    auto literal = var->expr;
+    if (!dynamic_cast<const LiteralNode<std::string_view> *>(literal) &&
+        !dynamic_cast<const LiteralNode<double> *>(literal) &&
+        !dynamic_cast<const LiteralNode<bool> *>(literal))
+        return false;
+
+    auto value = literal->evaluate(Values());
+    return value && write_value(*value, text);
+}
+
+/* moves the content at the start and the end of the body of a set out of it, evaluating the value
+ * has no effects, so the content can merge with the one around the set */
+static bool peel(const nptr<StmtNode> &stmt, Arena &arena, std::vector<nptr<StmtNode>> &stmts)
+{
+    auto set = dynamic_cast<SetNode *>(stmt);
+    if (!set)
+        return false;
+
+    const auto body = set->body->stmts;
+    size_t begin = 0, end = body.size();
+
+    while (begin < end && dynamic_cast<ContentNode *>(body[begin]))
+        ++begin;
+    while (end > begin && dynamic_cast<ContentNode *>(body[end - 1]))
+        --end;
+
+    if (begin == 0 && end == body.size())
+        return false;
+
+    stmts.insert(stmts.end(), body.begin(), body.begin() + begin);
+    /* an assignment to an outer variable stays even if nothing is left in its scope */
+    if (begin < end || !set->declares) {
+        set->body->stmts = arena.list(std::vector<nptr<StmtNode>>(body.begin() + begin,
+                                                                   body.begin() + end));
+        stmts.push_back(set);
+    }
+    stmts.insert(stmts.end(), body.begin() + end, body.end());
+    return true;
+}
+
+void StmtListNode::coalesce(Arena &arena)
+{
+    std::vector<nptr<StmtNode>> merged;
+    bool changed = false;
+
+    /* the bodies are merged first so that their static ends can leave them */
+    std::vector<nptr<StmtNode>> flat;
+    for (const auto &stmt : stmts) {
+        stmt->coalesce(arena);
+        if (!peel(stmt, arena, flat))
+            flat.push_back(stmt);
+        else
+            changed = true;
+    }
+
+    if (changed)
+        stmts = arena.list(flat);
+
+    for (size_t i = 0; i < stmts.size();) {
+        std::string text;
+        size_t end = i;
+
+        while (end < stmts.size() && static_text(stmts[end], text))
+            ++end;
+
+        /* a single content node stays as it is */
+        if (end == i || (end == i + 1 && dynamic_cast<ContentNode *>(stmts[i]))) {
+            merged.push_back(stmts[i]);
+            i = std::max(end, i + 1);
+            continue;
+        }
+
+        auto content = arena.make<ContentNode>();
+        content->content = arena.intern(text);
+        merged.push_back(content);
+        changed = true;
+        i = end;
+    }
+
+    if (changed)
+        stmts = arena.list(merged);
+}
+
+void ForNode::coalesce(Arena &arena) { body->coalesce(arena); }
+
+void IfNode::coalesce(Arena &arena)
+{
+    body->coalesce(arena);
+    elze->coalesce(arena);
+}
+
+void SetNode::coalesce(Arena &arena) { body->coalesce(arena); }
+
+void MacroNode::coalesce(Arena &arena) { body->coalesce(arena); }
+
+void ImportNode::coalesce(Arena &arena)
+{
+    for (const auto &macro : macros)
+        macro->coalesce(arena);
+}
+
+void TemplateNode::coalesce(Arena &arena)
+{
+    for (const auto &import : imports)
+        import->coalesce(arena);
+
+    for (const auto &macro : macros)
+        macro->coalesce(arena);
+
+    body->coalesce(arena);
+}
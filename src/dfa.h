@@ -0,0 +1,16 @@
+#pragma once
+#include "token.h"
+
+/* a deterministic automaton that recognizes a set of token types, the tables are generated at build
+ * time by dfagen from the regular expressions in tokens.h */
+struct dfa {
+    unsigned num_classes;
+    const unsigned char *classes; /* byte -> character class */
+    const unsigned short *next;   /* state * num_classes + class -> state, 0 is the dead state */
+    const signed char *accept;    /* state -> index into types or -1 if not accepting */
+    const tk_type_ptr *types;     /* accepted types in order of priority */
+    unsigned num_skip;            /* the first num_skip types are delimiters that are skipped */
+
+    static const unsigned short DEAD = 0;
+    static const unsigned short START = 1;
+};
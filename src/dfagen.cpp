@@ -0,0 +1,408 @@
+/* build time generator for the lexer tables: compiles the regular expressions of the token types
+ * in tokens.h into one deterministic automaton per token set and writes them as C++ tables, the
+ * CONTENT, CODE_BLOCK and VAR_BLOCK types are recognized by a dedicated splitter in lexer.cpp */
+#include "tokens.h"
+#include <algorithm>
+#include <bitset>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+typedef std::bitset<256> charset;
+
+struct nfa_state {
+    std::vector<int> eps;
+    charset chars;
+    int next = -1;
+    int accept = -1;
+};
+
+class nfa
+{
+  public:
+    std::vector<nfa_state> states;
+
+    int add()
+    {
+        states.emplace_back();
+        return states.size() - 1;
+    }
+};
+
+/* recursive descent parser for the subset of the ECMAScript syntax used in tokens.h */
+class regex_compiler
+{
+  private:
+    typedef std::pair<int, int> fragment;
+
+    nfa &nfa_;
+    const std::string re_;
+    size_t pos_ = 0;
+
+    bool at_end() const { return pos_ >= re_.size(); }
+    char peek() const { return re_[pos_]; }
+
+    [[noreturn]] void error(const std::string &msg) const
+    {
+        throw std::runtime_error("regex '" + re_ + "': " + msg + " at " + std::to_string(pos_));
+    }
+
+    static charset char_class(const std::string &name)
+    {
+        charset set;
+        for (int c = 0; c < 256; ++c) {
+            if ((name == "digit" && isdigit(c)) || (name == "alpha" && isalpha(c)) ||
+                (name == "alnum" && isalnum(c)) || (name == "space" && isspace(c)))
+                set.set(c);
+        }
+
+        if (set.none())
+            throw std::runtime_error("unknown character class '" + name + "'");
+
+        return set;
+    }
+
+    charset escape()
+    {
+        if (at_end())
+            error("dangling escape");
+
+        switch (char c = re_[pos_++]) {
+        case 's':
+            return char_class("space");
+        case 'd':
+            return char_class("digit");
+        case 'w':
+            return char_class("alnum").set('_');
+        case 'n':
+            return charset().set('\n');
+        case 't':
+            return charset().set('\t');
+        default:
+            if (isalnum(c))
+                error("unsupported escape");
+            return charset().set(static_cast<unsigned char>(c));
+        }
+    }
+
+    charset bracket()
+    {
+        charset set;
+        bool negate = false;
+
+        if (!at_end() && peek() == '^') {
+            negate = true;
+            ++pos_;
+        }
+
+        while (!at_end() && peek() != ']') {
+            if (re_.compare(pos_, 2, "[:") == 0) {
+                auto end = re_.find(":]", pos_);
+                if (end == std::string::npos)
+                    error("unterminated character class");
+                set |= char_class(re_.substr(pos_ + 2, end - pos_ - 2));
+                pos_ = end + 2;
+            } else if (peek() == '\\') {
+                ++pos_;
+                set |= escape();
+            } else {
+                unsigned char lo = re_[pos_++];
+                unsigned char hi = lo;
+
+                if (pos_ + 1 < re_.size() && peek() == '-' && re_[pos_ + 1] != ']') {
+                    hi = re_[pos_ + 1];
+                    pos_ += 2;
+                }
+
+                for (unsigned c = lo; c <= hi; ++c)
+                    set.set(c);
+            }
+        }
+
+        if (at_end())
+            error("unterminated bracket expression");
+        ++pos_;
+
+        return negate ? ~set : set;
+    }
+
+    fragment chars(const charset &set)
+    {
+        int start = nfa_.add();
+        int end = nfa_.add();
+        nfa_.states[start].chars = set;
+        nfa_.states[start].next = end;
+        return {start, end};
+    }
+
+    fragment atom()
+    {
+        char c = re_[pos_++];
+
+        switch (c) {
+        case '(': {
+            auto frag = alternation();
+            if (at_end() || peek() != ')')
+                error("expected ')'");
+            ++pos_;
+            return frag;
+        }
+        case '[':
+            return chars(bracket());
+        case '\\':
+            return chars(escape());
+        case '.':
+            return chars(~charset().set('\n'));
+        case '*':
+        case '+':
+        case '?':
+        case ')':
+        case '|':
+            error("unexpected operator");
+        default:
+            return chars(charset().set(static_cast<unsigned char>(c)));
+        }
+    }
+
+    fragment repetition()
+    {
+        auto frag = atom();
+
+        while (!at_end() && (peek() == '*' || peek() == '+' || peek() == '?')) {
+            char op = re_[pos_++];
+            int start = nfa_.add();
+            int end = nfa_.add();
+
+            nfa_.states[start].eps.push_back(frag.first);
+            nfa_.states[frag.second].eps.push_back(end);
+
+            if (op != '+')
+                nfa_.states[start].eps.push_back(end);
+            if (op != '?')
+                nfa_.states[frag.second].eps.push_back(frag.first);
+
+            frag = {start, end};
+        }
+
+        return frag;
+    }
+
+    fragment concatenation()
+    {
+        int start = nfa_.add();
+        int end = start;
+
+        while (!at_end() && peek() != '|' && peek() != ')') {
+            auto frag = repetition();
+            nfa_.states[end].eps.push_back(frag.first);
+            end = frag.second;
+        }
+
+        return {start, end};
+    }
+
+    fragment alternation()
+    {
+        int start = nfa_.add();
+        int end = nfa_.add();
+
+        for (;;) {
+            auto frag = concatenation();
+            nfa_.states[start].eps.push_back(frag.first);
+            nfa_.states[frag.second].eps.push_back(end);
+
+            if (at_end() || peek() != '|')
+                break;
+            ++pos_;
+        }
+
+        return {start, end};
+    }
+
+  public:
+    regex_compiler(nfa &n, const std::string &re) : nfa_(n), re_(re) {}
+
+    /* adds the expression to the automaton and returns its start state */
+    int compile(int accept)
+    {
+        auto frag = alternation();
+        if (!at_end())
+            error("unbalanced ')'");
+
+        nfa_.states[frag.second].accept = accept;
+        return frag.first;
+    }
+};
+
+class dfa_builder
+{
+  private:
+    typedef std::vector<int> state_set;
+
+    const nfa &nfa_;
+    std::map<state_set, unsigned> ids_;
+    std::vector<state_set> sets_;
+
+    state_set closure(state_set set) const
+    {
+        std::vector<bool> seen(nfa_.states.size());
+        std::vector<int> todo(set);
+
+        for (int s : set)
+            seen[s] = true;
+
+        while (!todo.empty()) {
+            int s = todo.back();
+            todo.pop_back();
+
+            for (int e : nfa_.states[s].eps) {
+                if (!seen[e]) {
+                    seen[e] = true;
+                    set.push_back(e);
+                    todo.push_back(e);
+                }
+            }
+        }
+
+        std::sort(set.begin(), set.end());
+        return set;
+    }
+
+    unsigned id(const state_set &set)
+    {
+        auto it = ids_.find(set);
+        if (it != ids_.end())
+            return it->second;
+
+        ids_.emplace(set, sets_.size());
+        sets_.push_back(set);
+        return sets_.size() - 1;
+    }
+
+  public:
+    std::vector<std::vector<unsigned>> next; /* state -> byte -> state */
+    std::vector<int> accept;
+
+    dfa_builder(const nfa &n, const state_set &start) : nfa_(n)
+    {
+        id(state_set());
+        id(closure(start));
+
+        for (size_t i = 0; i < sets_.size(); ++i) {
+            std::vector<unsigned> row(256, 0);
+            int acc = -1;
+
+            for (int s : sets_[i]) {
+                int a = nfa_.states[s].accept;
+                if (a >= 0 && (acc < 0 || a < acc))
+                    acc = a;
+            }
+
+            for (int c = 0; c < 256 && i != 0; ++c) {
+                state_set move;
+                for (int s : sets_[i]) {
+                    if (nfa_.states[s].chars.test(c))
+                        move.push_back(nfa_.states[s].next);
+                }
+
+                if (!move.empty())
+                    row[c] = id(closure(move));
+            }
+
+            next.push_back(row);
+            accept.push_back(acc);
+        }
+    }
+};
+
+static void write_table(std::ostream &o, const std::string &name, const tk_type_vec &skip,
+                        const tk_type_vec &accept)
+{
+    tk_type_vec types(skip);
+    types.insert(types.end(), accept.begin(), accept.end());
+
+    nfa n;
+    std::vector<int> start;
+    for (size_t i = 0; i < types.size(); ++i)
+        start.push_back(regex_compiler(n, types[i]->regexp()).compile(i));
+
+    dfa_builder d(n, start);
+    const size_t num_states = d.next.size();
+
+    if (num_states > 0xffff || types.size() > 127)
+        throw std::runtime_error(name + ": automaton too large");
+
+    /* bytes with identical transitions in every state share a class */
+    std::map<std::vector<unsigned>, unsigned> class_ids;
+    std::vector<unsigned> classes(256);
+    std::vector<int> representative;
+
+    for (int c = 0; c < 256; ++c) {
+        std::vector<unsigned> column;
+        for (const auto &row : d.next)
+            column.push_back(row[c]);
+
+        auto it = class_ids.emplace(column, class_ids.size());
+        if (it.second)
+            representative.push_back(c);
+        classes[c] = it.first->second;
+    }
+
+    o << "static const unsigned char " << name << "_CLASSES[] = {";
+    for (int c = 0; c < 256; ++c)
+        o << (c % 32 ? " " : "\n    ") << classes[c] << ",";
+    o << "};\n\n";
+
+    o << "static const unsigned short " << name << "_NEXT[] = {";
+    for (const auto &row : d.next) {
+        o << "\n   ";
+        for (int c : representative)
+            o << " " << row[c] << ",";
+    }
+    o << "};\n\n";
+
+    o << "static const signed char " << name << "_ACCEPT[] = {";
+    for (size_t s = 0; s < num_states; ++s)
+        o << (s % 32 ? " " : "\n    ") << d.accept[s] << ",";
+    o << "};\n\n";
+
+    o << "static const tk_type_ptr " << name << "_TYPES[] = {";
+    for (const auto &type : types)
+        o << "\n    tk_types::" << type->name() << ",";
+    o << "};\n\n";
+
+    o << "static const dfa " << name << "_DFA{" << representative.size() << ", " << name
+      << "_CLASSES, " << name << "_NEXT, " << name << "_ACCEPT, " << name << "_TYPES, "
+      << skip.size() << "};\n\n";
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        std::cerr << "Usage:\n\t" << argv[0] << " OUTPUT\n";
+        return EXIT_FAILURE;
+    }
+
+    try {
+        std::ostringstream o;
+        o << "/* generated by dfagen from tokens.h, do not edit */\n"
+          << "#pragma once\n"
+          << "#include \"dfa.h\"\n"
+          << "#include \"tokens.h\"\n\n";
+
+        write_table(o, "CODE", CODE_DELIMITER, CODE_TOKENS);
+        write_table(o, "VAR", VAR_DELIMITER, VAR_TOKENS);
+
+        std::ofstream out(argv[1]);
+        out.exceptions(std::ios::failbit | std::ios::badbit);
+        out << o.str();
+
+    } catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
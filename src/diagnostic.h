@@ -0,0 +1,32 @@
+#pragma once
+#include <exception>
+#include <string>
+
+namespace cinja
+{
+enum class severity { WARNING, ERROR };
+
+/* a message about a template, lines start at 1 and are 0 if the message is about no line */
+struct diagnostic {
+    severity level;
+    long line;
+    std::string message;
+};
+}
+
+/* base class for the errors in a template that stop its compilation */
+class CompileError : public std::exception
+{
+  protected:
+    std::string what_;
+    long line_ = 0;
+
+    CompileError() = default;
+
+  public:
+    CompileError(const std::string &what, long line) : what_(what), line_(line) {}
+
+    /* the line the error refers to starting at 1, or 0 if it is unknown */
+    long line() const { return line_; }
+    const char *what() const noexcept override { return what_.c_str(); }
+};
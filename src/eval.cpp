@@ -0,0 +1,491 @@
+#include "ast.h"
+#include <cmath>
+#include <sstream>
+
+/* calls nest at most this deep at compile time, deeper ones are left to the generated code */
+static const unsigned max_depth = 512;
+
+/* compares two values of the same type */
+template <typename T> static std::optional<Value> compare(BinOp op, const T &lhs, const T &rhs)
+{
+    switch (op) {
+    case BinOp::EQ:
+        return lhs == rhs;
+    case BinOp::NEQ:
+        return lhs != rhs;
+    case BinOp::GT:
+        return lhs > rhs;
+    case BinOp::GE:
+        return lhs >= rhs;
+    case BinOp::LT:
+        return lhs < rhs;
+    case BinOp::LE:
+        return lhs <= rhs;
+    default:
+        return std::nullopt;
+    }
+}
+
+static std::optional<Value> arithmetic(BinOp op, double lhs, double rhs)
+{
+    double value;
+
+    switch (op) {
+    case BinOp::ADD:
+        value = lhs + rhs;
+        break;
+    case BinOp::SUB:
+        value = lhs - rhs;
+        break;
+    case BinOp::MUL:
+        value = lhs * rhs;
+        break;
+    case BinOp::DIV:
+        value = lhs / rhs;
+        break;
+    default:
+        return compare(op, lhs, rhs);
+    }
+
+    /* infinities and nans have no literal, they are left to the generated code */
+    if (!std::isfinite(value))
+        return std::nullopt;
+
+    return value;
+}
+
+/* int arithmetic as in C++, overflows and divisions by zero are undefined there and left to the
+ * generated code */
+static std::optional<Value> integer(BinOp op, int lhs, int rhs)
+{
+    long long value;
+
+    switch (op) {
+    case BinOp::ADD:
+        value = static_cast<long long>(lhs) + rhs;
+        break;
+    case BinOp::SUB:
+        value = static_cast<long long>(lhs) - rhs;
+        break;
+    case BinOp::MUL:
+        value = static_cast<long long>(lhs) * rhs;
+        break;
+    case BinOp::DIV:
+        if (rhs == 0)
+            return std::nullopt;
+        value = lhs / rhs;
+        break;
+    default:
+        return compare(op, lhs, rhs);
+    }
+
+    if (!is_int(value))
+        return std::nullopt;
+
+    return static_cast<int>(value);
+}
+
+/* the value of a number as a double, ints are converted as in mixed C++ arithmetic */
+static std::optional<double> number(const Value &value)
+{
+    if (auto i = std::get_if<int>(&value))
+        return *i;
+
+    if (auto d = std::get_if<double>(&value))
+        return *d;
+
+    return std::nullopt;
+}
+
+std::optional<Value> IdNode::evaluate(const Values &values) const
+{
+    auto value = values.find(sym);
+    if (binding || !nspace.empty() || value == values.end())
+        return std::nullopt;
+
+    return value->second;
+}
+
+std::optional<Value> UnOpNode::evaluate(const Values &values) const
+{
+    auto value = arg->evaluate(values);
+    if (!value)
+        return std::nullopt;
+
+    if (auto b = std::get_if<bool>(&*value); b && op == UnOp::NOT)
+        return !*b;
+
+    if (auto i = std::get_if<int>(&*value); i && op == UnOp::NEG)
+        return -*i;
+
+    if (auto d = std::get_if<double>(&*value); d && op == UnOp::NEG)
+        return -*d;
+
+    return std::nullopt;
+}
+
+std::optional<Value> apply(BinOp op, const Value &lhs, const Value &rhs)
+{
+    auto a = std::get_if<int>(&lhs), b = std::get_if<int>(&rhs);
+    if (a && b)
+        return integer(op, *a, *b);
+
+    if (auto x = number(lhs), y = number(rhs); x && y)
+        return arithmetic(op, *x, *y);
+
+    if (lhs.index() != rhs.index())
+        return std::nullopt;
+
+    if (auto s = std::get_if<std::string_view>(&lhs))
+        return compare(op, *s, std::get<std::string_view>(rhs));
+
+    const bool p = std::get<bool>(lhs), q = std::get<bool>(rhs);
+    switch (op) {
+    case BinOp::AND:
+        return p && q;
+    case BinOp::OR:
+        return p || q;
+    case BinOp::EQ:
+        return p == q;
+    case BinOp::NEQ:
+        return p != q;
+    default:
+        return std::nullopt;
+    }
+}
+
+std::optional<Value> BinOpNode::evaluate(const Values &values) const
+{
+    auto ops = chain(this);
+    auto value = ops.front()->lhs->evaluate(values);
+
+    for (const auto &op : ops) {
+        if (!value || op->op == BinOp::DOT || op->op == BinOp::ARROW)
+            return std::nullopt;
+
+        auto rhs = op->rhs->evaluate(values);
+        if (!rhs)
+            return std::nullopt;
+
+        value = apply(op->op, *value, *rhs);
+    }
+
+    return value;
+}
+
+/* takes the cost of a step from the budget, false once it is used up */
+static bool spend(Evaluation &ev, size_t cost)
+{
+    if (cost > ev.left)
+        return false;
+
+    ev.left -= cost;
+    return true;
+}
+
+bool write_value(const Value &value, std::string &out)
+{
+    /* escapes in strings are left to the C++ compiler */
+    if (auto str = std::get_if<std::string_view>(&value)) {
+        if (str->find('\\') != std::string_view::npos)
+            return false;
+
+        out += *str;
+        return true;
+    }
+
+    std::ostringstream s;
+    std::visit([&](auto v) { s << v; }, value);
+    out += s.str();
+    return true;
+}
+
+/* binds a symbol to a value for the lifetime of the binding */
+class Binding
+{
+  private:
+    Values &values_;
+    sym_id sym_;
+    std::optional<Value> hidden_;
+
+  public:
+    Binding(Values &values, sym_id sym, const Value &value) : values_(values), sym_(sym)
+    {
+        auto bound = values_.find(sym);
+        if (bound != values_.end())
+            hidden_ = bound->second;
+
+        values_[sym] = value;
+    }
+
+    ~Binding()
+    {
+        if (hidden_)
+            values_[sym_] = *hidden_;
+        else
+            values_.erase(sym_);
+    }
+};
+
+template <typename T>
+static std::optional<T> known(const nptr<ExprNode> &expr, const Values &values)
+{
+    auto value = expr->evaluate(values);
+    if (!value || !std::holds_alternative<T>(*value))
+        return std::nullopt;
+
+    return std::get<T>(*value);
+}
+
+bool StmtListNode::evaluate(Evaluation &ev, std::string &out) const
+{
+    for (const auto &stmt : stmts) {
+        if (!stmt->evaluate(ev, out))
+            return false;
+    }
+
+    return true;
+}
+
+bool ContentNode::evaluate(Evaluation &ev, std::string &out) const
+{
+    if (!spend(ev, 1 + content.size()))
+        return false;
+
+    out += content;
+    return true;
+}
+
+bool VarNode::evaluate(Evaluation &ev, std::string &out) const
+{
+    auto value = expr->evaluate(ev.values);
+    const size_t size = out.size();
+
+    return value && write_value(*value, out) && spend(ev, 1 + out.size() - size);
+}
+
+bool IfNode::evaluate(Evaluation &ev, std::string &out) const
+{
+    auto value = known<bool>(condition, ev.values);
+    if (!value || !spend(ev, 1))
+        return false;
+
+    return *value ? body->evaluate(ev, out) : elze->evaluate(ev, out);
+}
+
+bool ForNode::evaluate(Evaluation &ev, std::string &out) const
+{
+    auto list = dynamic_cast<const ListNode *>(collection);
+    if (!list || !spend(ev, 1))
+        return false;
+
+    for (const auto &element : list->values) {
+        auto value = element->evaluate(ev.values);
+        if (!value)
+            return false;
+
+        Binding binding(ev.values, var->sym, *value);
+
+        auto selected = known<bool>(filter, ev.values);
+        if (!selected || (*selected && !body->evaluate(ev, out)))
+            return false;
+    }
+
+    return true;
+}
+
+bool SetNode::evaluate(Evaluation &ev, std::string &out) const
+{
+    auto result = value->evaluate(ev.values);
+    if (!result || !spend(ev, 1))
+        return false;
+
+    if (declares) {
+        Binding binding(ev.values, var->sym, *result);
+        return body->evaluate(ev, out);
+    }
+
+    /* the assignment outlives the body, a variable bound outside of the evaluation would keep
+     * its old value */
+    auto assigned = ev.values.find(var->sym);
+    if (assigned == ev.values.end())
+        return false;
+
+    assigned->second = *result;
+    return body->evaluate(ev, out);
+}
+
+bool CallNode::evaluate(Evaluation &ev, std::string &out) const
+{
+    auto found = ev.macros.find(id->sym);
+    if (found == ev.macros.end() || ev.depth >= max_depth || !spend(ev, 1))
+        return false;
+
+    const auto &macro = found->second;
+    if (args.size() > macro->args.size())
+        return false;
+
+    /* the macro sees its arguments only */
+    Values values;
+    for (size_t i = 0; i < macro->args.size(); ++i) {
+        const auto &arg = macro->args[i];
+
+        std::optional<Value> value;
+        if (i < args.size())
+            value = args[i]->evaluate(ev.values);
+        else if (arg->dflt)
+            value = arg->dflt->evaluate(Values());
+
+        if (!value)
+            return false;
+
+        values[arg->id->sym] = *value;
+    }
+
+    std::swap(ev.values, values);
+    ++ev.depth;
+
+    bool ok = macro->body->evaluate(ev, out);
+
+    --ev.depth;
+    std::swap(ev.values, values);
+    return ok;
+}
+
+static bool always(const nptr<ExprNode> &expr)
+{
+    auto lit = dynamic_cast<const LiteralNode<bool> *>(expr);
+    return lit && lit->value;
+}
+
+/* evaluates the statement on its own budget, or on what is left of the one of the loop that is
+ * unrolled, and returns its output as content */
+static nptr<StmtListNode> output(Evaluation &ev, const StmtNode &stmt)
+{
+    std::string out;
+    const size_t budget = ev.unrolling ? std::min(ev.budget, ev.room) : ev.budget;
+    ev.left = budget;
+
+    if (!stmt.evaluate(ev, out))
+        return nullptr;
+
+    if (ev.unrolling)
+        ev.room -= budget - ev.left;
+
+    auto list = ev.arena.make<StmtListNode>();
+    if (out.empty())
+        return list;
+
+    auto content = ev.arena.make<ContentNode>();
+    content->content = ev.arena.intern(out);
+    list->stmts = ev.arena.list(std::vector<nptr<StmtNode>>{content});
+    return list;
+}
+
+void StmtListNode::expand(Evaluation &ev)
+{
+    std::vector<nptr<StmtNode>> expanded;
+    bool changed = false;
+
+    for (const auto &stmt : stmts) {
+        auto replacement = stmt->expand(ev);
+        if (!replacement) {
+            expanded.push_back(stmt);
+            continue;
+        }
+
+        expanded.insert(expanded.end(), replacement->stmts.begin(), replacement->stmts.end());
+        changed = true;
+    }
+
+    if (changed)
+        stmts = ev.arena.list(expanded);
+}
+
+nptr<StmtListNode> CallNode::expand(Evaluation &ev) { return output(ev, *this); }
+
+nptr<StmtListNode> ForNode::expand(Evaluation &ev)
+{
+    if (auto out = output(ev, *this))
+        return out;
+
+    /* a loop over a literal list that depends on other values is unrolled if its copies fit the
+     * budget, each copy binds the variable to one element so that they fold on their own */
+    auto list = dynamic_cast<ListNode *>(collection);
+    const size_t size = list ? list->values.size() * body->nodes() : 0;
+    const size_t room = ev.unrolling ? ev.room : ev.budget;
+    if (!list || size > room) {
+        body->expand(ev);
+        return nullptr;
+    }
+
+    Inlining in{ev.arena, ev.syms};
+    std::vector<nptr<StmtNode>> copies;
+
+    for (const auto &element : list->values) {
+        auto bind = ev.arena.make<SetNode>();
+        bind->var = var;
+        bind->value = element;
+        bind->declares = true;
+        bind->body = body->clone(in);
+
+        if (!always(filter)) {
+            auto branch = ev.arena.make<IfNode>();
+            branch->condition = filter->clone(in);
+            branch->body = bind->body;
+            branch->elze = ev.arena.make<StmtListNode>();
+            bind->body = ev.arena.make<StmtListNode>(
+                ev.arena.list(std::vector<nptr<StmtNode>>{branch}));
+        }
+
+        copies.push_back(bind);
+    }
+
+    auto unrolled = ev.arena.make<StmtListNode>(ev.arena.list(copies));
+
+    /* the loops and calls in the copies are expanded on what is left of the budget of the
+     * outermost unrolled loop, so nested loops cannot multiply the code */
+    const bool outer = !ev.unrolling;
+    ev.room = room - size;
+    ev.unrolling = true;
+
+    Folding f{ev.arena, ev.syms};
+    unrolled->fold(f);
+    unrolled->expand(ev);
+
+    ev.unrolling = !outer;
+    return unrolled;
+}
+
+nptr<StmtListNode> IfNode::expand(Evaluation &ev)
+{
+    body->expand(ev);
+    elze->expand(ev);
+    return nullptr;
+}
+
+nptr<StmtListNode> SetNode::expand(Evaluation &ev)
+{
+    body->expand(ev);
+    return nullptr;
+}
+
+void TemplateNode::expand(Arena &arena, SymbolTable &syms, size_t budget)
+{
+    if (budget == 0)
+        return;
+
+    Evaluation ev{arena, syms, {}, {}, budget};
+    for (const auto &import : imports) {
+        for (const auto &macro : import->macros)
+            ev.macros[macro->id->sym] = macro;
+    }
+
+    for (const auto &macro : macros)
+        ev.macros[macro->id->sym] = macro;
+
+    for (const auto &entry : ev.macros)
+        entry.second->body->expand(ev);
+
+    body->expand(ev);
+}
@@ -0,0 +1,246 @@
+#include "ast.h"
+
+template <typename T> static const T *literal(const nptr<ExprNode> &expr)
+{
+    auto lit = dynamic_cast<const LiteralNode<T> *>(expr);
+    return lit ? &lit->value : nullptr;
+}
+
+static bool is_literal(const nptr<ExprNode> &expr)
+{
+    return literal<bool>(expr) || literal<double>(expr) || literal<std::string_view>(expr);
+}
+
+template <typename T> static nptr<ExprNode> make_literal(Folding &f, const T &value, long line)
+{
+    return f.arena.make<LiteralNode<T>>(value, line);
+}
+
+/* returns the literal of a value of the expression, if it has one */
+static nptr<ExprNode> constant(Folding &f, const Value &value, const ExprNode &expr)
+{
+    if (auto i = std::get_if<int>(&value))
+        return make_literal(f, static_cast<double>(*i), expr.begin_line());
+
+    /* a double with an integral value would be written as an int literal */
+    if (auto d = std::get_if<double>(&value))
+        return is_int(*d) ? nullptr : make_literal(f, *d, expr.begin_line());
+
+    if (auto b = std::get_if<bool>(&value))
+        return make_literal(f, *b, expr.begin_line());
+
+    return make_literal(f, std::get<std::string_view>(value), expr.begin_line());
+}
+
+/* returns the literal of the value of the expression if it only depends on literals */
+static nptr<ExprNode> constant(Folding &f, const ExprNode &expr)
+{
+    auto value = expr.evaluate(Values());
+    return value ? constant(f, *value, expr) : nullptr;
+}
+
+nptr<ExprNode> IdNode::fold(Folding &f)
+{
+    if (binding || !nspace.empty())
+        return this;
+
+    auto constant = f.constants.find(sym);
+    if (constant == f.constants.end())
+        return this;
+
+    return constant->second;
+}
+
+nptr<ExprNode> ListNode::fold(Folding &f)
+{
+    for (auto &value : values)
+        value = value->fold(f);
+
+    return this;
+}
+
+nptr<ExprNode> UnOpNode::fold(Folding &f)
+{
+    arg = arg->fold(f);
+
+    auto folded = constant(f, *this);
+    return folded ? folded : this;
+}
+
+nptr<ExprNode> BinOpNode::fold(Folding &f)
+{
+    /* a chain is folded from its innermost operator, the value of the operators folded so far
+     * saves evaluating the chain again for every one of them */
+    auto ops = chain(this);
+    nptr<ExprNode> folded = ops.front()->lhs->fold(f);
+    auto value = folded->evaluate(Values());
+
+    for (const auto &op : ops) {
+        op->lhs = folded;
+        folded = op->fold_operator(f, value);
+    }
+
+    return folded;
+}
+
+/* folds the right operand and the operator, whose left operand is folded and has the given value
+ * if it is known, which is replaced by the value of the operator */
+nptr<ExprNode> BinOpNode::fold_operator(Folding &f, std::optional<Value> &value)
+{
+    if (op == BinOp::DOT || op == BinOp::ARROW) {
+        value.reset();
+        return this;
+    }
+
+    rhs = rhs->fold(f);
+
+    auto r = rhs->evaluate(Values());
+    value = value && r ? apply(op, *value, *r) : std::nullopt;
+
+    if (op == BinOp::AND || op == BinOp::OR) {
+        /* the operands have no side effects, so a literal on either side decides the result or
+         * leaves the other operand, which is only taken as it is if it is a bool already */
+        const bool dominant = op == BinOp::OR;
+        for (auto [operand, other] : {std::pair(lhs, rhs), std::pair(rhs, lhs)}) {
+            auto known = literal<bool>(operand);
+            if (!known)
+                continue;
+
+            if (*known == dominant)
+                return make_literal(f, dominant, begin_line());
+
+            if (other->type() == typeid(bool))
+                return other;
+        }
+
+        return this;
+    }
+
+    auto folded = value ? constant(f, *value, *this) : nullptr;
+    return folded ? folded : this;
+}
+
+static nptr<StmtListNode> empty(Folding &f) { return f.arena.make<StmtListNode>(); }
+
+void StmtListNode::fold(Folding &f)
+{
+    std::vector<nptr<StmtNode>> folded;
+    bool changed = false;
+
+    for (const auto &stmt : stmts) {
+        auto replacement = stmt->fold(f);
+        if (!replacement) {
+            folded.push_back(stmt);
+            continue;
+        }
+
+        folded.insert(folded.end(), replacement->stmts.begin(), replacement->stmts.end());
+        changed = true;
+    }
+
+    if (changed)
+        stmts = f.arena.list(folded);
+}
+
+nptr<StmtListNode> ForNode::fold(Folding &f)
+{
+    collection = collection->fold(f);
+
+    /* the loop variable hides a constant of the same name */
+    auto hidden = f.constants.find(var->sym);
+    nptr<ExprNode> constant = nullptr;
+    if (hidden != f.constants.end()) {
+        constant = hidden->second;
+        f.constants.erase(hidden);
+    }
+
+    filter = filter->fold(f);
+    body->fold(f);
+
+    if (constant)
+        f.constants[var->sym] = constant;
+
+    if (auto value = literal<bool>(filter); (value && !*value) || body->stmts.empty())
+        return empty(f);
+
+    return nullptr;
+}
+
+nptr<StmtListNode> IfNode::fold(Folding &f)
+{
+    condition = condition->fold(f);
+    body->fold(f);
+    elze->fold(f);
+
+    if (auto value = literal<bool>(condition))
+        return *value ? body : elze;
+
+    if (body->stmts.empty() && elze->stmts.empty())
+        return empty(f);
+
+    return nullptr;
+}
+
+nptr<StmtListNode> SetNode::fold(Folding &f)
+{
+    value = value->fold(f);
+
+    /* a variable that is declared with a literal and never assigned again is replaced by the
+     * literal wherever it is used */
+    if (!declares || f.syms.reassigned(var->sym) || !is_literal(value)) {
+        body->fold(f);
+        return nullptr;
+    }
+
+    /* the variable hides a constant of the same name, which an inlined macro can declare again */
+    auto hidden = f.constants.find(var->sym);
+    nptr<ExprNode> constant = hidden != f.constants.end() ? hidden->second : nullptr;
+
+    f.constants[var->sym] = value;
+    body->fold(f);
+
+    if (constant)
+        f.constants[var->sym] = constant;
+    else
+        f.constants.erase(var->sym);
+
+    return body;
+}
+
+nptr<StmtListNode> VarNode::fold(Folding &f)
+{
+    expr = expr->fold(f);
+    return nullptr;
+}
+
+nptr<StmtListNode> CallNode::fold(Folding &f)
+{
+    for (auto &arg : args)
+        arg = arg->fold(f);
+
+    return nullptr;
+}
+
+void MacroNode::fold(Arena &arena, const SymbolTable &syms)
+{
+    Folding f{arena, syms, {}};
+    body->fold(f);
+}
+
+void ImportNode::fold(Arena &arena, const SymbolTable &syms)
+{
+    for (const auto &macro : macros)
+        macro->fold(arena, syms);
+}
+
+void TemplateNode::fold(Arena &arena, const SymbolTable &syms)
+{
+    for (const auto &import : imports)
+        import->fold(arena, syms);
+
+    for (const auto &macro : macros)
+        macro->fold(arena, syms);
+
+    Folding f{arena, syms, {}};
+    body->fold(f);
+}
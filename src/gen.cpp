@@ -1,22 +1,22 @@
 #include "ast.h"
-#include <iostream>
+#include "cache.h"
+#include <cctype>
+#include <charconv>
+#include <iomanip>
 #include <map>
-#include <set>
 #include <sstream>
 
-template <typename T> static void insert_sym(T &syms, const std::string &sym) { syms.insert(sym); }
+/* the names of the namespaces of the imported macros in the generated code by the ones they are
+ * parsed in, set while the definitions of a template are printed */
+static thread_local std::map<std::string_view, std::string> *namespaces = nullptr;
 
-template <typename T> static void erase_sym(T &syms, const std::string &sym)
+static std::string_view namespace_name(std::string_view nspace)
 {
-    const auto it(syms.find(sym));
+    if (!namespaces)
+        return nspace;
 
-    if (it != syms.end())
-        syms.erase(it);
-}
-
-template <typename T> static bool contains_sym(const T &syms, const std::string &sym)
-{
-    return (syms.find(sym) != syms.end());
+    auto name = namespaces->find(nspace);
+    return name == namespaces->end() ? nspace : name->second;
 }
 
 template <typename T, typename F>
@@ -41,35 +41,52 @@ Node::ostr &join(Node::ostr &o, const T &collection, const std::string &sep, F p
 
 static inline std::string indent(unsigned lvl) { return std::string(lvl, '\t'); }
 
-Node::ostr &ForNode::print(ostr &o, set &fsym, mset &bsym, unsigned lvl) const
+Node::ostr &ForNode::print(ostr &o, unsigned lvl) const
 {
     o << indent(lvl) << "for (const auto& ";
 
-    var->print(o, fsym, bsym) << " : ";
-    collection->print(o, fsym, bsym) << ") {\n";
+    var->print(o) << " : ";
+    collection->print(o) << ") {\n";
+
+    /* folding leaves a literal true for loops without a filter */
+    auto always = dynamic_cast<const LiteralNode<bool> *>(filter);
+    if (always && always->value) {
+        body->print(o, lvl + 1);
+        return o << indent(lvl) << "}\n";
+    }
 
-    insert_sym(bsym, var->name);
     o << indent(lvl + 1) << "if (";
-    filter->print(o, fsym, bsym) << ") {\n";
-    body->print(o, fsym, bsym, lvl + 2);
+    filter->print(o) << ") {\n";
+    body->print(o, lvl + 2);
     o << indent(lvl + 1) << "}\n";
     o << indent(lvl) << "}\n";
-    erase_sym(bsym, var->name);
 
     return o;
 }
 
-Node::ostr &IfNode::print(ostr &o, set &fsym, mset &bsym, unsigned lvl) const
+Node::ostr &IfNode::print(ostr &o, unsigned lvl) const
 {
     o << indent(lvl) << "if (";
-    condition->print(o, fsym, bsym, lvl) << ") {\n";
-    body->print(o, fsym, bsym, lvl + 1);
-    o << indent(lvl) << "} else {\n";
-    elze->print(o, fsym, bsym, lvl + 1);
+
+    if (body->stmts.empty()) {
+        o << "!(";
+        condition->print(o, lvl) << ")) {\n";
+        elze->print(o, lvl + 1);
+        return o << indent(lvl) << "}\n";
+    }
+
+    condition->print(o, lvl) << ") {\n";
+    body->print(o, lvl + 1);
+
+    if (!elze->stmts.empty()) {
+        o << indent(lvl) << "} else {\n";
+        elze->print(o, lvl + 1);
+    }
+
     return o << indent(lvl) << "}\n";
 }
 
-template <> Node::ostr &LiteralNode<bool>::print(ostr &o, set &fsym, mset &bsym, unsigned lvl) const
+template <> Node::ostr &LiteralNode<bool>::print(ostr &o, unsigned lvl) const
 {
     if (value)
         return o << "true";
@@ -77,39 +94,47 @@ template <> Node::ostr &LiteralNode<bool>::print(ostr &o, set &fsym, mset &bsym,
         return o << "false";
 }
 
-template <>
-Node::ostr &LiteralNode<std::string>::print(ostr &o, set &fsym, mset &bsym, unsigned lvl) const
+/* integral numbers are int literals, the others are printed so that they read back as the same
+ * double */
+template <> Node::ostr &LiteralNode<double>::print(ostr &o, unsigned lvl) const
 {
-    return o << "std::string(\"" << value.c_str() << "\")";
-}
+    if (is_int(value))
+        return o << static_cast<int>(value);
 
-Node::ostr &FieldNode::print(ostr &o, set &fsym, mset &bsym, unsigned lvl) const
-{
-    return o << name;
+    char buf[32];
+    auto end = std::to_chars(buf, buf + sizeof(buf), value).ptr;
+    o.write(buf, end - buf);
+
+    if (std::string_view(buf, end - buf).find_first_of(".e") == std::string_view::npos)
+        o << ".0";
+
+    return o;
 }
 
-Node::ostr &IdNode::print(ostr &o, set &fsym, mset &bsym, unsigned lvl) const
+template <> Node::ostr &LiteralNode<std::string_view>::print(ostr &o, unsigned lvl) const
 {
-    if (binding)
-        return o << name;
+    return o << "std::string(\"" << value << "\")";
+}
 
-    std::string fname(full_name());
+Node::ostr &FieldNode::print(ostr &o, unsigned lvl) const { return o << name; }
 
-    if (!contains_sym(bsym, fname))
-        insert_sym(fsym, fname);
+Node::ostr &IdNode::print(ostr &o, unsigned lvl) const
+{
+    if (!binding && !nspace.empty())
+        o << namespace_name(nspace) << "::";
 
-    return o << fname;
+    return o << name;
 }
 
-Node::ostr &UnOpNode::print(ostr &o, set &fsym, mset &bsym, unsigned lvl) const
+Node::ostr &UnOpNode::print(ostr &o, unsigned lvl) const
 {
     static std::map<UnOp, std::string> str_map{{UnOp::NEG, "-"}, {UnOp::NOT, "!"}};
 
     o << str_map[op] << "(";
-    return arg->print(o, fsym, bsym) << ")";
+    return arg->print(o) << ")";
 }
 
-Node::ostr &BinOpNode::print(ostr &o, set &fsym, mset &bsym, unsigned lvl) const
+Node::ostr &BinOpNode::print(ostr &o, unsigned lvl) const
 {
     static std::map<BinOp, std::string> str_map{
         {BinOp::ADD, "+"}, {BinOp::SUB, "-"},   {BinOp::MUL, "*"},  {BinOp::DIV, "/"},
@@ -117,100 +142,193 @@ Node::ostr &BinOpNode::print(ostr &o, set &fsym, mset &bsym, unsigned lvl) const
         {BinOp::LT, "<"},  {BinOp::LE, "<="},   {BinOp::AND, "&&"}, {BinOp::OR, "||"},
         {BinOp::DOT, "."}, {BinOp::ARROW, "->"}};
 
-    std::string pad(" ");
+    auto ops = chain(this);
+    for (size_t i = 0; i < ops.size(); ++i)
+        o << "(";
 
-    if (op == BinOp::DOT || op == BinOp::ARROW)
-        pad = "";
+    ops.front()->lhs->print(o);
+    for (const auto &op : ops) {
+        std::string pad(op->op == BinOp::DOT || op->op == BinOp::ARROW ? "" : " ");
+        o << pad << str_map[op->op] << pad;
+        op->rhs->print(o) << ")";
+    }
 
-    o << "(";
-    lhs->print(o, fsym, bsym) << pad << str_map[op] << pad;
-    return rhs->print(o, fsym, bsym) << ")";
+    return o;
 }
 
 Node::ostr &print_macro_proto(Node::ostr &o, const nptr<MacroNode> &m, unsigned lvl)
 {
-    o << indent(lvl) << "template<typename O, ";
-    join(o, m->args, ", ", [](auto &o, auto &v, auto i) { o << "typename T" << i; });
+    o << indent(lvl) << "template<typename O";
+    join(o, m->args, "", [](auto &o, auto &v, auto i) { o << ", typename T" << i; });
     o << ">\n";
 
-    o << indent(lvl) << "void " << m->id->name << "(O &o, ";
-    join(o, m->args, ", ", [](auto &o, auto &v, auto i) { o << "T" << i << " " << v->id->name; });
+    o << indent(lvl) << "void " << m->id->name << "(O &o";
+    join(o, m->args, "", [](auto &o, auto &v, auto i) { o << ", T" << i << " " << v->id->name; });
     o << ")";
 
     return o;
 }
 
-Node::ostr &TemplateNode::print(ostr &o, set &fsym, mset &bsym, unsigned lvl) const
+/* prints the template parameters of render_template and its parameter list */
+static Node::ostr &print_template_proto(Node::ostr &o, const nlist<std::string_view> &params)
 {
-    o << "#include <iostream>\n"
-      << "#include <string>\n\n"
-      << "namespace macros {\n";
+    o << "template<typename O";
+    join(o, params, "", [](auto &o, auto &v, auto i) { o << ", typename T" << i; });
+    o << ">\n";
+
+    o << "void render_template(O &o";
+    join(o, params, "", [](auto &o, auto &v, auto i) { o << ", T" << i << " " << v; });
+    return o << ")";
+}
+
+/* prints the render_template specialization for the concrete types */
+static Node::ostr &print_instance_proto(Node::ostr &o, const nlist<std::string_view> &params,
+                                        const Instantiation &inst)
+{
+    o << "void render_template<" << inst.sink;
+    join(o, inst.types, "", [](auto &o, auto &v, auto i) { o << ", " << v; });
+    o << ">(" << inst.sink << " &o";
+    join(o, params, "", [&](auto &o, auto &v, auto i) { o << ", " << inst.types[i] << " " << v; });
+    return o << ")";
+}
 
-    join(o, this->macros, "", [&](auto &o, auto &v, auto i) {
+static Node::ostr &print_includes(Node::ostr &o, const Instantiation &inst)
+{
+    for (const auto &include : inst.includes) {
+        if (include[0] == '<')
+            o << "#include " << include << "\n";
+        else
+            o << "#include \"" << include << "\"\n";
+    }
+
+    return o;
+}
+
+/* prints a namespace with the declarations and then the definitions of the macros */
+static Node::ostr &print_macros(Node::ostr &o, std::string_view nspace,
+                                const nlist<nptr<MacroNode>> &macros, unsigned lvl)
+{
+    o << "namespace " << nspace << " {\n";
+
+    join(o, macros, "", [&](auto &o, auto &v, auto i) {
         print_macro_proto(o, v, lvl + 1) << ";\n\n";
-        insert_sym(bsym, v->id->full_name());
     });
 
-    join(o, this->macros, "\n", [&](auto &o, auto &v, auto i) {
-        set fsym;
-
+    join(o, macros, "\n", [&](auto &o, auto &v, auto i) {
         print_macro_proto(o, v, 1) << " {\n";
+        v->body->print(o, lvl + 2);
+        o << indent(lvl + 1) << "}\n";
+    });
 
-        for (auto &arg : v->args)
-            insert_sym(bsym, arg->id->name);
+    return o << "}\n\n";
+}
 
-        v->body->print(o, fsym, bsym, lvl + 2);
+Node::ostr &ImportNode::print(ostr &o, unsigned lvl) const
+{
+    /* the code of the macros depends on the options and on the template that imports them, so
+     * the namespace is named by the hash of the code, the macros of different templates only
+     * share a name if their definitions are the same */
+    std::ostringstream code;
+    print_macros(code, nspace, macros, lvl);
+
+    std::ostringstream name;
+    name << "macros_" << std::hex << std::setw(16) << std::setfill('0') << fnv1a(code.str());
+    if (namespaces)
+        (*namespaces)[nspace] = name.str();
+
+    /* the guard keeps the macros from being defined twice if the code of several templates that
+     * import them ends up in one translation unit */
+    std::string guard = "CINJA_" + name.str();
+    for (auto &c : guard)
+        c = toupper(c);
+
+    o << "#ifndef " << guard << "\n#define " << guard << "\n";
+    print_macros(o, name.str(), macros, lvl);
+    return o << "#endif\n\n";
+}
 
-        for (auto &arg : v->args)
-            erase_sym(bsym, arg->id->name);
+Node::ostr &TemplateNode::print_definitions(ostr &o, unsigned lvl) const
+{
+    /* the imports come before the ones that import them */
+    std::map<std::string_view, std::string> names;
+    struct Scope {
+        std::map<std::string_view, std::string> *outer = namespaces;
+        explicit Scope(std::map<std::string_view, std::string> &names) { namespaces = &names; }
+        ~Scope() { namespaces = outer; }
+    } scope(names);
+
+    for (const auto &import : imports)
+        import->print(o, lvl);
+
+    print_macros(o, "macros", macros, lvl);
+
+    print_template_proto(o, params) << " {\n";
+    this->body->print(o, lvl + 1);
+    return o << "}\n";
+}
 
-        o << indent(lvl + 1) << "}\n";
+Node::ostr &TemplateNode::print(ostr &o, unsigned lvl) const
+{
+    o << "#include <iostream>\n"
+      << "#include <string>\n\n";
 
-        for (const auto &sym : fsym)
-            std::cerr << "Unknown symbol '" << sym << "' in macro '" << v->id->name << "'\n";
-    });
+    return print_definitions(o, lvl);
+}
 
-    o << "}\n\n";
+Node::ostr &TemplateNode::print_declaration(ostr &o, const Instantiation &inst) const
+{
+    o << "#pragma once\n";
+    print_includes(o, inst) << "\n";
 
-    std::ostringstream body;
-    this->body->print(body, fsym, bsym, lvl + 1);
+    print_template_proto(o, params) << ";\n\n";
 
-    o << "template<typename O, ";
-    join(o, fsym, ", ", [](auto &o, auto &v, auto i) { o << "typename T" << i; });
-    o << ">\n";
+    o << "extern template ";
+    print_instance_proto(o, params, inst) << ";\n\n";
 
-    o << "void render_template(O &o, ";
-    join(o, fsym, ", ", [](auto &o, auto &v, auto i) { o << "T" << i << " " << v; });
+    /* deduction would never pick the instantiated types, so calls without template arguments
+     * resolve to this overload instead */
+    o << "inline void render_template(" << inst.sink << " &o";
+    join(o, params, "", [&](auto &o, auto &v, auto i) { o << ", " << inst.types[i] << " " << v; });
     o << ") {\n";
+    o << indent(1) << "render_template<" << inst.sink;
+    join(o, inst.types, "", [](auto &o, auto &v, auto i) { o << ", " << v; });
+    o << ">(o";
+    join(o, params, "", [](auto &o, auto &v, auto i) { o << ", " << v; });
+    return o << ");\n}\n";
+}
 
-    o << body.str();
-    o << "}\n";
-    return o;
+Node::ostr &TemplateNode::print_instantiation(ostr &o, const Instantiation &inst) const
+{
+    print_includes(o, inst);
+    o << "#include <string>\n\n";
+
+    print_definitions(o, 0) << "\n";
+
+    o << "template ";
+    return print_instance_proto(o, params, inst) << ";\n";
 }
 
-Node::ostr &SetNode::print(ostr &o, set &fsym, mset &bsym, unsigned lvl) const
+Node::ostr &SetNode::print(ostr &o, unsigned lvl) const
 {
     o << indent(lvl) << "{\n" << indent(lvl + 1);
 
-    if (!contains_sym(bsym, var->name))
+    if (declares)
         o << "auto ";
 
-    var->print(o, fsym, bsym, lvl) << " = ";
-    value->print(o, fsym, bsym, lvl) << ";\n";
+    var->print(o, lvl) << " = ";
+    value->print(o, lvl) << ";\n";
 
-    insert_sym(bsym, var->name);
-    body->print(o, fsym, bsym, lvl + 1);
-    erase_sym(bsym, var->name);
+    body->print(o, lvl + 1);
 
     return o << indent(lvl) << "}\n";
 }
 
-Node::ostr &ListNode::print(ostr &o, set &fsym, mset &bsym, unsigned lvl) const
+Node::ostr &ListNode::print(ostr &o, unsigned lvl) const
 {
     o << "{";
 
     for (const auto &node : this->values) {
-        node->print(o, fsym, bsym, lvl);
+        node->print(o, lvl);
         if (node != this->values.back())
             o << ", ";
     }
@@ -219,45 +337,44 @@ Node::ostr &ListNode::print(ostr &o, set &fsym, mset &bsym, unsigned lvl) const
     return o;
 }
 
-Node::ostr &StmtListNode::print(ostr &o, StmtListNode::set &fsym, StmtListNode::mset &bsym,
-                                unsigned lvl) const
+Node::ostr &StmtListNode::print(ostr &o, unsigned lvl) const
 {
     for (const auto &stmt : stmts)
-        stmt->print(o, fsym, bsym, lvl);
+        stmt->print(o, lvl);
 
     return o;
 }
 
-Node::ostr &ContentNode::print(ostr &o, set &fsym, mset &bsym, unsigned lvl) const
+Node::ostr &ContentNode::print(ostr &o, unsigned lvl) const
 {
     return o << indent(lvl) << "o << u8R\"content\"\"\"(" << content << ")content\"\"\"\";\n";
 }
 
-Node::ostr &VarNode::print(ostr &o, set &fsym, mset &bsym, unsigned lvl) const
+Node::ostr &VarNode::print(ostr &o, unsigned lvl) const
 {
     o << indent(lvl) << "o << ";
-    return expr->print(o, fsym, bsym) << ";\n";
+    return expr->print(o) << ";\n";
 }
 
-Node::ostr &ArgumentNode::print(ostr &o, set &fsym, mset &bsym, unsigned lvl) const
+Node::ostr &ArgumentNode::print(ostr &o, unsigned lvl) const
 {
-    this->id->print(o, fsym, bsym, lvl);
+    this->id->print(o, lvl);
 
     if (this->dflt) {
         o << " = ";
-        this->dflt->print(o, fsym, bsym, lvl);
+        this->dflt->print(o, lvl);
     }
 
     return o;
 }
 
-Node::ostr &MacroNode::print(ostr &o, set &fsym, mset &bsym, unsigned lvl) const { return o; }
+Node::ostr &MacroNode::print(ostr &o, unsigned lvl) const { return o; }
 
-Node::ostr &CallNode::print(ostr &o, set &fsym, mset &bsym, unsigned lvl) const
+Node::ostr &CallNode::print(ostr &o, unsigned lvl) const
 {
     o << indent(lvl);
-    this->id->print(o, fsym, bsym, lvl) << "(o, ";
-    join(o, this->args, ", ", [&](auto &o, auto &v, auto i) { v->print(o, fsym, bsym, 0); });
+    this->id->print(o, lvl) << "(o";
+    join(o, this->args, "", [&](auto &o, auto &v, auto i) { v->print(o << ", ", 0); });
     o << ");\n";
     return o;
 }
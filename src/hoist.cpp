@@ -0,0 +1,167 @@
+#include "ast.h"
+
+bool IdNode::invariant(const SymbolTable &syms, sym_id var) const
+{
+    /* a symbol that is assigned to may be assigned to in the loop */
+    return sym != var && !syms.reassigned(sym);
+}
+
+bool ListNode::invariant(const SymbolTable &syms, sym_id var) const
+{
+    for (const auto &value : values) {
+        if (!value->invariant(syms, var))
+            return false;
+    }
+
+    return true;
+}
+
+bool UnOpNode::invariant(const SymbolTable &syms, sym_id var) const
+{
+    return arg->invariant(syms, var);
+}
+
+bool BinOpNode::invariant(const SymbolTable &syms, sym_id var) const
+{
+    auto ops = chain(this);
+    if (!ops.front()->lhs->invariant(syms, var))
+        return false;
+
+    for (const auto &op : ops) {
+        if (!op->rhs->invariant(syms, var))
+            return false;
+    }
+
+    return true;
+}
+
+static bool always(const nptr<ExprNode> &expr)
+{
+    auto lit = dynamic_cast<const LiteralNode<bool> *>(expr);
+    return lit && lit->value;
+}
+
+/* wraps the statements in a branch on condition, either of them may be missing */
+static nptr<IfNode> guard(Arena &arena, nptr<ExprNode> condition, nptr<StmtNode> then,
+                          nptr<StmtNode> otherwise = nullptr)
+{
+    auto wrap = [&](nptr<StmtNode> stmt) {
+        if (!stmt)
+            return arena.make<StmtListNode>();
+        return arena.make<StmtListNode>(arena.list(std::vector<nptr<StmtNode>>{stmt}));
+    };
+
+    auto branch = arena.make<IfNode>();
+    branch->condition = condition;
+    branch->body = wrap(then);
+    branch->elze = wrap(otherwise);
+    return branch;
+}
+
+/* returns a copy of the loop with the branch at the top of its body replaced by one side */
+static nptr<ForNode> specialize(Arena &arena, const ForNode &loop, size_t at,
+                                const nptr<StmtListNode> &side)
+{
+    std::vector<nptr<StmtNode>> stmts(loop.body->stmts.begin(), loop.body->stmts.end());
+    stmts.erase(stmts.begin() + at);
+    stmts.insert(stmts.begin() + at, side->stmts.begin(), side->stmts.end());
+
+    if (stmts.empty())
+        return nullptr;
+
+    auto copy = arena.make<ForNode>(loop);
+    copy->body = arena.make<StmtListNode>(arena.list(stmts));
+    copy->unswitched = true;
+    return copy;
+}
+
+/* whether the statements contain a copy of an unswitched loop, unswitching around it again would
+ * double the copies with every level of nesting, the loops know it of their bodies already */
+static bool contains_unswitched(const StmtListNode &list)
+{
+    for (const auto &stmt : list.stmts) {
+        if (auto loop = dynamic_cast<const ForNode *>(stmt)) {
+            if (loop->unswitched)
+                return true;
+        } else if (auto branch = dynamic_cast<const IfNode *>(stmt)) {
+            if (contains_unswitched(*branch->body) || contains_unswitched(*branch->elze))
+                return true;
+        } else if (auto set = dynamic_cast<const SetNode *>(stmt)) {
+            if (contains_unswitched(*set->body))
+                return true;
+        }
+    }
+
+    return false;
+}
+
+void StmtListNode::hoist(Arena &arena, const SymbolTable &syms)
+{
+    for (auto &stmt : stmts)
+        stmt = stmt->hoist(arena, syms);
+}
+
+nptr<StmtNode> ForNode::hoist(Arena &arena, const SymbolTable &syms)
+{
+    body->hoist(arena, syms);
+
+    nptr<ExprNode> hoisted = nullptr;
+    if (!always(filter) && filter->invariant(syms, var->sym)) {
+        hoisted = filter;
+        filter = arena.make<LiteralNode<bool>>(true, filter->begin_line());
+    }
+
+    nptr<StmtNode> result = this;
+
+    /* the loop is unswitched on the first invariant branch at the top of its body, which
+     * duplicates the rest of the body once, a statement is never part of two unswitched loops so
+     * the code at most doubles */
+    unswitched = contains_unswitched(*body);
+    for (size_t i = 0; i < body->stmts.size() && !unswitched; ++i) {
+        auto branch = dynamic_cast<IfNode *>(body->stmts[i]);
+        if (!branch || !branch->condition->invariant(syms, var->sym))
+            continue;
+
+        auto then = specialize(arena, *this, i, branch->body);
+        auto otherwise = specialize(arena, *this, i, branch->elze);
+
+        if (then || otherwise)
+            result = guard(arena, branch->condition, then, otherwise);
+
+        break;
+    }
+
+    return hoisted ? guard(arena, hoisted, result) : result;
+}
+
+nptr<StmtNode> IfNode::hoist(Arena &arena, const SymbolTable &syms)
+{
+    body->hoist(arena, syms);
+    elze->hoist(arena, syms);
+    return this;
+}
+
+nptr<StmtNode> SetNode::hoist(Arena &arena, const SymbolTable &syms)
+{
+    body->hoist(arena, syms);
+    return this;
+}
+
+void MacroNode::hoist(Arena &arena, const SymbolTable &syms) { body->hoist(arena, syms); }
+
+void ImportNode::hoist(Arena &arena, const SymbolTable &syms)
+{
+    for (const auto &macro : macros)
+        macro->hoist(arena, syms);
+}
+
+void TemplateNode::hoist(Arena &arena, const SymbolTable &syms)
+{
+    for (const auto &import : imports)
+        import->hoist(arena, syms);
+
+    for (const auto &macro : macros)
+        macro->hoist(arena, syms);
+
+    body->hoist(arena, syms);
+}
@@ -0,0 +1,308 @@
+#include "ast.h"
+#include <string>
+
+/* macros with more nodes than this in their body stay calls */
+static const size_t max_inline_size = 64;
+
+nptr<ExprNode> IdNode::clone(Inlining &in)
+{
+    auto renamed = in.renames.find(sym);
+    if (renamed == in.renames.end())
+        return this;
+
+    auto copy = in.arena.make<IdNode>(*renamed->second);
+    copy->binding = binding;
+    return copy;
+}
+
+nptr<ExprNode> ListNode::clone(Inlining &in)
+{
+    std::vector<nptr<ExprNode>> copies;
+    for (const auto &value : values)
+        copies.push_back(value->clone(in));
+
+    auto copy = in.arena.make<ListNode>(*this);
+    copy->values = in.arena.list(copies);
+    return copy;
+}
+
+nptr<ExprNode> UnOpNode::clone(Inlining &in)
+{
+    auto copy = in.arena.make<UnOpNode>(*this);
+    copy->arg = arg->clone(in);
+    return copy;
+}
+
+nptr<ExprNode> BinOpNode::clone(Inlining &in)
+{
+    auto ops = chain(this);
+    nptr<ExprNode> copy = ops.front()->lhs->clone(in);
+
+    for (const auto &op : ops) {
+        auto outer = in.arena.make<BinOpNode>(*op);
+        outer->lhs = copy;
+        outer->rhs = op->rhs->clone(in);
+        copy = outer;
+    }
+
+    return copy;
+}
+
+nptr<StmtListNode> StmtListNode::clone(Inlining &in) const
+{
+    std::vector<nptr<StmtNode>> copies;
+    for (const auto &stmt : stmts)
+        copies.push_back(stmt->clone(in));
+
+    return in.arena.make<StmtListNode>(in.arena.list(copies));
+}
+
+nptr<StmtNode> ForNode::clone(Inlining &in)
+{
+    auto copy = in.arena.make<ForNode>(*this);
+    copy->var = static_cast<IdNode *>(var->clone(in));
+    copy->collection = collection->clone(in);
+    copy->filter = filter->clone(in);
+    copy->body = body->clone(in);
+    return copy;
+}
+
+nptr<StmtNode> IfNode::clone(Inlining &in)
+{
+    auto copy = in.arena.make<IfNode>(*this);
+    copy->condition = condition->clone(in);
+    copy->body = body->clone(in);
+    copy->elze = elze->clone(in);
+    return copy;
+}
+
+nptr<StmtNode> SetNode::clone(Inlining &in)
+{
+    auto copy = in.arena.make<SetNode>(*this);
+    copy->var = static_cast<IdNode *>(var->clone(in));
+    copy->value = value->clone(in);
+    copy->body = body->clone(in);
+    return copy;
+}
+
+nptr<StmtNode> VarNode::clone(Inlining &in)
+{
+    auto copy = in.arena.make<VarNode>(*this);
+    copy->expr = expr->clone(in);
+    return copy;
+}
+
+nptr<StmtNode> CallNode::clone(Inlining &in)
+{
+    std::vector<nptr<ExprNode>> copies;
+    for (const auto &arg : args)
+        copies.push_back(arg->clone(in));
+
+    auto copy = in.arena.make<CallNode>(*this);
+    copy->args = in.arena.list(copies);
+    return copy;
+}
+
+size_t StmtListNode::nodes() const
+{
+    NodeCounts counts;
+    count(counts);
+
+    size_t nodes = 0;
+    for (const auto &count : counts)
+        nodes += count.second;
+
+    return nodes;
+}
+
+void StmtListNode::callees(std::set<sym_id> &ids) const
+{
+    for (const auto &stmt : stmts)
+        stmt->callees(ids);
+}
+
+void ForNode::callees(std::set<sym_id> &ids) const { body->callees(ids); }
+
+void IfNode::callees(std::set<sym_id> &ids) const
+{
+    body->callees(ids);
+    elze->callees(ids);
+}
+
+void SetNode::callees(std::set<sym_id> &ids) const { body->callees(ids); }
+
+void CallNode::callees(std::set<sym_id> &ids) const { ids.insert(id->sym); }
+
+void StmtListNode::inline_calls(Inlining &in)
+{
+    std::vector<nptr<StmtNode>> inlined;
+    bool changed = false;
+
+    for (const auto &stmt : stmts) {
+        auto replacement = stmt->inline_calls(in);
+        if (!replacement) {
+            inlined.push_back(stmt);
+            continue;
+        }
+
+        inlined.insert(inlined.end(), replacement->stmts.begin(), replacement->stmts.end());
+        changed = true;
+    }
+
+    if (changed)
+        stmts = in.arena.list(inlined);
+}
+
+nptr<StmtListNode> ForNode::inline_calls(Inlining &in)
+{
+    body->inline_calls(in);
+    return nullptr;
+}
+
+nptr<StmtListNode> IfNode::inline_calls(Inlining &in)
+{
+    body->inline_calls(in);
+    elze->inline_calls(in);
+    return nullptr;
+}
+
+nptr<StmtListNode> SetNode::inline_calls(Inlining &in)
+{
+    body->inline_calls(in);
+    return nullptr;
+}
+
+nptr<StmtListNode> CallNode::inline_calls(Inlining &in)
+{
+    auto found = in.macros.find(id->sym);
+    if (found == in.macros.end())
+        return nullptr;
+
+    const auto &macro = found->second;
+    if (args.size() > macro->args.size())
+        return nullptr;
+
+    for (size_t i = args.size(); i < macro->args.size(); ++i) {
+        if (!macro->args[i]->dflt)
+            return nullptr;
+    }
+
+    /* every argument is bound to a fresh name in a scope of its own, so an argument cannot refer
+     * to one that is bound before it and the fold pass sees the literal ones as constants, the
+     * names in the copied body are those of the macro and differ from the ones of the caller */
+    std::string site = "inl" + std::to_string(++in.sites) + "_";
+    if (!in.caller.empty())
+        site = "inl_" + std::string(in.caller) + "_" + std::to_string(in.sites) + "_";
+
+    std::vector<nptr<SetNode>> binds;
+    in.renames.clear();
+
+    for (size_t i = 0; i < macro->args.size(); ++i) {
+        const auto &param = macro->args[i]->id;
+        auto name = in.arena.intern(site + std::string(param->name));
+
+        auto ref = in.arena.make<IdNode>(name, param->begin_line());
+        ref->sym = in.syms.intern(name);
+        if (in.syms.reassigned(param->sym))
+            in.syms.reassign(ref->sym);
+
+        auto bind = in.arena.make<SetNode>();
+        bind->var = in.arena.make<IdNode>(name, param->begin_line(), std::string_view(), true);
+        bind->var->sym = ref->sym;
+        bind->value = i < args.size() ? args[i] : macro->args[i]->dflt->clone(in);
+        bind->declares = true;
+        binds.push_back(bind);
+
+        in.renames[param->sym] = ref;
+    }
+
+    /* the calls in the body of the macro are inlined already */
+    auto body = macro->body->clone(in);
+    in.renames.clear();
+
+    for (auto bind = binds.rbegin(); bind != binds.rend(); ++bind) {
+        (*bind)->body = body;
+        body = in.arena.make<StmtListNode>(in.arena.list(std::vector<nptr<StmtNode>>{*bind}));
+    }
+
+    return body;
+}
+
+typedef std::map<sym_id, std::set<sym_id>> CallGraph;
+
+/* whether the macro can end up calling itself */
+static bool recursive(const CallGraph &graph, sym_id macro)
+{
+    std::set<sym_id> seen;
+    std::vector<sym_id> todo{macro};
+
+    while (!todo.empty()) {
+        auto caller = graph.find(todo.back());
+        todo.pop_back();
+
+        if (caller == graph.end())
+            continue;
+
+        for (const auto &callee : caller->second) {
+            if (callee == macro)
+                return true;
+
+            if (seen.insert(callee).second)
+                todo.push_back(callee);
+        }
+    }
+
+    return false;
+}
+
+/* appends the macro to order after the ones it calls, the calls that close a cycle are skipped */
+static void callees_first(const CallGraph &graph, const std::map<sym_id, nptr<MacroNode>> &macros,
+                          sym_id macro, std::set<sym_id> &seen,
+                          std::vector<nptr<MacroNode>> &order)
+{
+    auto found = macros.find(macro);
+    if (found == macros.end() || !seen.insert(macro).second)
+        return;
+
+    for (const auto &callee : graph.at(macro))
+        callees_first(graph, macros, callee, seen, order);
+
+    order.push_back(found->second);
+}
+
+void TemplateNode::inline_calls(Arena &arena, SymbolTable &syms)
+{
+    std::vector<nptr<MacroNode>> all(macros.begin(), macros.end());
+    for (const auto &import : imports)
+        all.insert(all.end(), import->macros.begin(), import->macros.end());
+
+    CallGraph graph;
+    std::map<sym_id, nptr<MacroNode>> by_sym;
+    for (const auto &macro : all) {
+        macro->body->callees(graph[macro->id->sym]);
+        by_sym[macro->id->sym] = macro;
+    }
+
+    std::set<sym_id> seen;
+    std::vector<nptr<MacroNode>> order;
+    for (const auto &macro : all)
+        callees_first(graph, by_sym, macro->id->sym, seen, order);
+
+    /* the callees are inlined into a macro before it is measured, so a chain of macros that call
+     * each other several times is inlined as long as the whole copy stays small, a macro that uses
+     * symbols of the caller would see the ones at the call site when inlined */
+    Inlining in{arena, syms};
+    for (const auto &macro : order) {
+        in.caller = macro->id->name;
+        in.sites = 0;
+        macro->body->inline_calls(in);
+
+        if (macro->closed && macro->body->nodes() <= max_inline_size &&
+            !recursive(graph, macro->id->sym))
+            in.macros[macro->id->sym] = macro;
+    }
+
+    in.caller = std::string_view();
+    in.sites = 0;
+    body->inline_calls(in);
+}
@@ -1,85 +1,272 @@
 #include "lexer.h"
+#include "diagnostic.h"
+#include "lexer_tables.h"
 #include "tokens.h"
-#include <iostream>
-#include <regex>
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <thread>
 
-const tk tk_iterator::end_of_input(tk_types::EOI, "", 0);
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
-static void tokenize(const std::string &string, tk_vec &tokens, const tk_type_vec &accept,
-                     const tk_type_vec &ignore = tk_type_vec(), long line_no = 0)
+/* returns the length of the longest token recognized by the automaton at data[pos] and its index
+ * in the accepted types, or length 1 and index -1 if no token starts there */
+static size_t scan(const dfa &automaton, const unsigned char *data, size_t pos, size_t size,
+                   int &match)
 {
-    using namespace std;
-    using namespace std::regex_constants;
-
-    const auto flags = match_not_null | match_continuous;
-    auto it = string.begin();
-    auto end = string.end();
-    bool found;
-    smatch match;
-
-    while (it != end) {
-        found = false;
-
-        for (const auto &type : ignore) {
-            if (std::regex_search(it, end, match, type->regexp(), flags)) {
-                const auto &str = match.str();
-                line_no += std::count(str.begin(), str.end(), '\n');
-                it += match.length();
-                found = true;
-                break;
-            }
+    unsigned state = dfa::START;
+    size_t length = 1;
+    match = -1;
+
+    for (size_t i = pos; i < size; ++i) {
+        state = automaton.next[state * automaton.num_classes + automaton.classes[data[i]]];
+
+        if (state == dfa::DEAD)
+            break;
+
+        if (automaton.accept[state] >= 0) {
+            match = automaton.accept[state];
+            length = i - pos + 1;
         }
+    }
 
-        if (found)
-            continue;
+    return length;
+}
 
-        tk_type_ptr token_type;
-        std::string token_value;
+/* returns the position of the first "{%" or "{{" in data[pos, size) or size if there is none */
+static size_t find_block_start(const char *data, size_t pos, size_t size)
+{
+#if defined(__AVX2__)
+    const __m256i open = _mm256_set1_epi8('{');
+    const __m256i percent = _mm256_set1_epi8('%');
 
-        for (const auto &type : accept) {
-            if (!std::regex_search(it, end, match, type->regexp(), flags))
-                continue;
+    for (; pos + 33 <= size; pos += 32) {
+        auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + pos));
+        auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + pos + 1));
+        auto second = _mm256_or_si256(_mm256_cmpeq_epi8(b, open), _mm256_cmpeq_epi8(b, percent));
+        unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, open), second));
 
-            if (token_value.length() < match.str().length()) {
-                token_value = match.str();
-                token_type = type;
-                found = true;
-            }
+        if (mask)
+            return pos + __builtin_ctz(mask);
+    }
+#elif defined(__SSE2__)
+    const __m128i open = _mm_set1_epi8('{');
+    const __m128i percent = _mm_set1_epi8('%');
+
+    for (; pos + 17 <= size; pos += 16) {
+        auto a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos));
+        auto b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos + 1));
+        auto second = _mm_or_si128(_mm_cmpeq_epi8(b, open), _mm_cmpeq_epi8(b, percent));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, open), second));
+
+        if (mask)
+            return pos + __builtin_ctz(mask);
+    }
+#endif
+
+    for (; pos + 1 < size; ++pos) {
+        if (data[pos] == '{' && (data[pos + 1] == '%' || data[pos + 1] == '{'))
+            return pos;
+    }
+
+    return size;
+}
+
+/* returns the position after the delimiter that closes the block starting at data[pos - 2] or
+ * std::string_view::npos if the block is not closed, the block content is read in pairs of the
+ * delimiter and another character just like the CODE_BLOCK and VAR_BLOCK expressions do */
+static size_t find_block_end(const char *data, size_t pos, size_t size, char delim)
+{
+    const char *c;
+
+    while ((c = static_cast<const char *>(std::memchr(data + pos, delim, size - pos)))) {
+        pos = c - data;
+
+        if (pos + 1 >= size)
+            break;
+        if (data[pos + 1] == '}')
+            return pos + 2;
+
+        pos += 2;
+    }
+
+    return std::string_view::npos;
+}
+
+static CompileError invalid_block(std::string_view content, size_t pos, long line_no)
+{
+    std::stringstream s;
+
+    if (pos + 1 >= content.size())
+        s << "invalid token " << tk_types::UNKNOWN->name() << " (" << content[pos] << ")";
+    else if (content[pos + 1] == '%')
+        s << "unterminated " << tk_types::CODE_BLOCK->name();
+    else
+        s << "unterminated " << tk_types::VAR_BLOCK->name();
+
+    s << " on line " << std::to_string(line_no + 1);
+    return CompileError(s.str(), line_no + 1);
+}
+
+tk_stream::tk_stream(std::string_view content, long line_no) : content_(content), line_no_(line_no)
+{
+}
+
+bool tk_stream::next(tk &token)
+{
+    const char *data = content_.data();
+    const size_t size = content_.size();
+
+    for (;;) {
+        /* inside of a code or variable block */
+        while (pos_ < block_end_) {
+            int match;
+            size_t length = scan(*automaton_, reinterpret_cast<const unsigned char *>(data), pos_,
+                                 block_end_, match);
+
+            tk_type_ptr type = nullptr;
+            if (match < 0)
+                type = tk_types::UNKNOWN;
+            else if (static_cast<unsigned>(match) >= automaton_->num_skip)
+                type = automaton_->types[match];
+
+            if (type)
+                token = tk(type, content_.substr(pos_, length), line_no_);
+
+            line_no_ += std::count(data + pos_, data + pos_ + length, '\n');
+            pos_ += length;
+
+            if (type)
+                return true;
         }
 
-        if (found) {
-            tokens.emplace_back(token_type, token_value, line_no);
-            it += token_value.length();
-        } else {
-            tokens.emplace_back(tk_types::UNKNOWN, std::string(1, *it), line_no);
-            ++it;
+        if (pos_ >= size)
+            return false;
+
+        /* a content block extends up to the next "{%" or "{{", a single trailing "{" is
+         * invalid */
+        size_t start = find_block_start(data, pos_, size);
+
+        if (start == size && data[size - 1] == '{')
+            --start;
+
+        if (start > pos_) {
+            token = tk(tk_types::CONTENT, content_.substr(pos_, start - pos_), line_no_);
+            line_no_ += std::count(data + pos_, data + start, '\n');
+            pos_ = start;
+            return true;
         }
 
-        line_no += tokens.back().num_lines();
+        if (start + 1 < size)
+            block_end_ = find_block_end(data, start + 2, size, data[start + 1] == '%' ? '%' : '}');
+
+        if (start + 1 >= size || block_end_ == std::string_view::npos)
+            throw invalid_block(content_, start, line_no_);
+
+        automaton_ = data[start + 1] == '%' ? &CODE_DFA : &VAR_DFA;
+    }
+}
+
+tk tk_stream::at(size_t i)
+{
+    if (i + LOOKAHEAD < read_)
+        throw std::logic_error("token stream read too far behind");
+
+    while (read_ <= i) {
+        if (!next(window_[read_ % LOOKAHEAD]))
+            return tk(tk_types::EOI, "", 0);
+
+        ++read_;
     }
+
+    return window_[i % LOOKAHEAD];
 }
 
-tk_vec tokenize_template(const std::string &content)
+/* walks over the blocks of a template and returns about parts positions, all at block boundaries,
+ * where the template can be split for lexing, together with their line numbers */
+static std::vector<std::pair<size_t, long>> split_template(std::string_view content, unsigned parts)
 {
-    tk_vec tokens;
-    std::vector<tk> blocks;
-    tokenize(content, blocks, BLOCK_TOKENS);
-
-    for (const auto &block : blocks) {
-        if (block.type() == tk_types::CONTENT)
-            tokens.push_back(block);
-        else if (block.type() == tk_types::CODE_BLOCK)
-            tokenize(block.value(), tokens, CODE_TOKENS, CODE_DELIMITER, block.start_line());
-        else if (block.type() == tk_types::VAR_BLOCK)
-            tokenize(block.value(), tokens, VAR_TOKENS, VAR_DELIMITER, block.start_line());
-        else {
-            std::stringstream s;
-            s << "invalid token " << block.type()->name() << " (" << block.value() << ") on line "
-              << std::to_string(block.start_line() + 1);
-
-            throw std::runtime_error(s.str());
+    const char *data = content.data();
+    const size_t size = content.size();
+    const size_t part_size = size / parts + 1;
+    std::vector<std::pair<size_t, long>> cuts{{0, 0}};
+    size_t pos = 0;
+    long line_no = 0;
+
+    while (pos < size) {
+        if (pos >= cuts.back().first + part_size)
+            cuts.emplace_back(pos, line_no);
+
+        size_t start = find_block_start(data, pos, size);
+        size_t end = start + 1 < size
+                         ? find_block_end(data, start + 2, size, data[start + 1] == '%' ? '%' : '}')
+                         : std::string_view::npos;
+
+        /* invalid blocks are reported by the stream that lexes the last part */
+        if (end == std::string_view::npos)
+            break;
+
+        line_no += std::count(data + pos, data + end, '\n');
+        pos = end;
+    }
+
+    return cuts;
+}
+
+tk_store tokenize_template(std::string_view content, unsigned threads)
+{
+    if (content.size() > UINT32_MAX)
+        throw std::runtime_error("template too large");
+
+    /* lexing a part in parallel is only worth it for a few blocks at least */
+    const size_t min_part_size = 1 << 16;
+    threads = std::max(1u, std::min<unsigned>(threads, content.size() / min_part_size));
+
+    auto cuts = split_template(content, threads);
+    std::vector<tk_store> parts(cuts.size(), tk_store(content));
+    std::vector<std::exception_ptr> errors(cuts.size());
+    std::vector<std::thread> workers;
+
+    auto lex_part = [&](size_t i) {
+        try {
+            size_t end = i + 1 < cuts.size() ? cuts[i + 1].first : content.size();
+            tk_stream stream(content.substr(0, end), cuts[i].second);
+            tk token;
+
+            stream.skip(cuts[i].first);
+            while (stream.next(token)) {
+                parts[i].push_back(token.type(), token.value().data() - content.data(),
+                                   token.value().size(), token.start_line());
+            }
+        } catch (...) {
+            errors[i] = std::current_exception();
         }
+    };
+
+    for (size_t i = 1; i < cuts.size(); ++i)
+        workers.emplace_back(lex_part, i);
+
+    lex_part(0);
+
+    for (auto &worker : workers)
+        worker.join();
+
+    /* report the first error in the template to stay deterministic */
+    for (const auto &error : errors) {
+        if (error)
+            std::rethrow_exception(error);
     }
 
+    size_t total = 0;
+    for (const auto &part : parts)
+        total += part.size();
+
+    tk_store tokens(content);
+    tokens.reserve(total);
+    for (const auto &part : parts)
+        tokens.append(part);
+
     return tokens;
 }
@@ -2,52 +2,79 @@
 #include "token.h"
 #include <iterator>
 
-tk_vec tokenize_template(const std::string &content);
+struct dfa;
 
-class tk_iterator : public std::iterator<std::forward_iterator_tag, const tk>
+/* lexes a template on demand, only the last LOOKAHEAD tokens are kept */
+class tk_stream : public tk_source
 {
+  public:
+    static const size_t LOOKAHEAD = 2;
+
   private:
-    tk_vec::const_iterator it;
-    tk_vec::const_iterator end;
-    const static tk end_of_input;
+    std::string_view content_;
+    size_t pos_ = 0;
+    size_t block_end_ = 0;
+    const dfa *automaton_ = nullptr;
+    long line_no_ = 0;
+
+    size_t read_ = 0;
+    tk window_[LOOKAHEAD];
 
   public:
-    tk_iterator(const tk_vec::const_iterator &it, const tk_vec::const_iterator &end)
-        : it(it), end(end)
-    {
-    }
+    explicit tk_stream(std::string_view content, long line_no = 0);
 
-    tk_iterator(const tk_iterator &tk_it) : it(tk_it.it), end(tk_it.end) {}
+    /* continues lexing at the given position, which has to be at a block boundary */
+    void skip(size_t pos) { pos_ = block_end_ = pos; }
 
-    reference operator*() const
-    {
-        if (it == end)
-            return end_of_input;
+    /* reads the next token, returns false at the end of the input */
+    bool next(tk &token);
 
-        return it.operator*();
-    }
+    tk at(size_t i) override;
+};
 
-    pointer operator->() const
-    {
-        if (it == end)
-            return &end_of_input;
+/* lexes a whole template at once, large templates are split into parts at block boundaries that
+ * are lexed on up to the given number of threads */
+tk_store tokenize_template(std::string_view content, unsigned threads = 1);
 
-        return it.operator->();
+/* iterates over a token source and yields END_OF_INPUT tokens past its end */
+class tk_iterator
+{
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef const tk value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const tk *pointer;
+    typedef const tk &reference;
+
+  private:
+    tk_source *source;
+    size_t pos;
+    tk current;
+
+  public:
+    tk_iterator(tk_source &source, size_t pos = 0)
+        : source(&source), pos(pos), current(source.at(pos))
+    {
     }
 
+    /* the index of the current token in the source */
+    size_t position() const { return pos; }
+
+    reference operator*() const { return current; }
+    pointer operator->() const { return &current; }
+
     tk_iterator &operator++()
     {
-        if (it != end)
-            it.operator++();
+        if (current.type() != tk_types::EOI)
+            current = source->at(++pos);
 
         return *this;
     }
 
     tk_iterator operator++(int)
     {
-        if (it != end)
-            return tk_iterator(it++, end);
-
-        return tk_iterator(it, end);
+        tk_iterator tmp(*this);
+        ++*this;
+        return tmp;
     }
 };
@@ -1,31 +1,566 @@
-#include "lexer.h"
-#include "parser.h"
-#include "validate.h"
+#include "cache.h"
+#include "cinja.h"
+#include "source.h"
+#include "stats.h"
+#include <atomic>
+#include <chrono>
+#include <dirent.h>
 #include <fstream>
+#include <getopt.h>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <thread>
 #include <unistd.h>
 
 static void print_help(std::ostream &ostream, const std::string &prog)
 {
     ostream << "Usage:\n\t" << prog << " FLAGS FILE\n";
+    ostream << "\t" << prog << " FLAGS -d dir FILE...\n";
     ostream << "FLAGS:\n";
     ostream << "\t-o out  Write output to the given file\n";
+    ostream << "\t-d dir  Compile every FILE to a header with the same name in dir\n";
+    ostream << "\t-m file Read further templates for -d from file, one path per line\n";
+    ostream << "\t-j n    Use n threads, 0 uses all cores, the default for -d\n";
+    ostream << "\t-MD     Write the templates an output was compiled from to out.d\n";
+    ostream << "\t-MF f   Write the dependencies to f instead\n";
     ostream << "\t-h      Display this message\n";
+    ostream << "\t--cache=dir\n";
+    ostream << "\t        Reuse the code generated for identical templates from dir\n";
+    ostream << "\t--sink=type\n";
+    ostream << "\t        Split the output into a header that declares render_template for the\n";
+    ostream << "\t        sink type and a .cpp file that instantiates it\n";
+    ostream << "\t--param=name=type\n";
+    ostream << "\t        The type of the template variable name for --sink\n";
+    ostream << "\t--include=header\n";
+    ostream << "\t        A header that declares the types for --sink\n";
+    ostream << "\t--watch=dir\n";
+    ostream << "\t        Compile the templates in dir to the -d directory whenever they change\n";
+    ostream << "\t        and skip the templates that others extend or import\n";
+    ostream << "\t--no-optimize\n";
+    ostream << "\t        Generate the code for the template as it is written\n";
+    ostream << "\t--eval-budget=n\n";
+    ostream << "\t        Evaluate macro calls and loops with known inputs at compile time if they\n";
+    ostream << "\t        take at most n steps and bytes of output each, 0 disables it\n";
+    ostream << "\t--stats[=json]\n";
+    ostream << "\t        Report the time and memory of every phase on stderr\n";
+}
+
+static std::string error_message(const std::exception &e)
+{
+    if (auto se = dynamic_cast<const std::system_error *>(&e))
+        return se->code().message();
+
+    return e.what();
+}
+
+static void report(const std::string &prefix, const cinja::diagnostic &d)
+{
+    std::cerr << prefix << (d.level == cinja::severity::ERROR ? "Error: " : "Warning: ")
+              << d.message << std::endl;
+}
+
+/* escapes a path for a Makefile rule */
+static std::string make_escape(const std::string &path)
+{
+    std::string escaped;
+
+    for (char c : path) {
+        if (c == ' ' || c == '#')
+            escaped += '\\';
+        else if (c == '$')
+            escaped += '$';
+        escaped += c;
+    }
+
+    return escaped;
+}
+
+/* writes a Makefile rule in the format of gcc -MD that makes the outputs depend on the templates */
+static void write_depfile(const std::string &path, const std::vector<std::string> &outputs,
+                          const std::vector<std::string> &deps)
+{
+    std::string rule;
+
+    for (const auto &output : outputs)
+        rule += (rule.empty() ? "" : " ") + make_escape(output);
+
+    rule += ":";
+    for (const auto &dep : deps)
+        rule += " " + make_escape(dep);
+
+    write_if_changed(path, rule + "\n");
+}
+
+/* the part of the cache key for the options that change the generated code */
+static std::string options_key(const cinja::options &options)
+{
+    std::string key = options.sink + '\0' + std::to_string(options.eval_budget) +
+                      (options.optimize ? "" : "-O0");
+
+    for (const auto &param : options.param_types)
+        key += '\0' + param.first + '=' + param.second;
+    for (const auto &include : options.includes)
+        key += '\0' + include;
+
+    return key;
+}
+
+/* the implementation file of a split output replaces the extension of the header by ".cpp" */
+static std::string impl_path(const std::string &output)
+{
+    auto dot = output.find_last_of('.');
+
+    if (dot == std::string::npos || output.find('/', dot) != std::string::npos)
+        return output + ".cpp";
+
+    return output.substr(0, dot) + ".cpp";
+}
+
+/* extends the cache key of a template by the paths and the contents of the templates it extends,
+ * which are listed one per line in the manifest, returns false if one of them cannot be read */
+static bool extend_key(uint64_t &key, const std::string &manifest, std::vector<std::string> &deps)
+{
+    std::istringstream in(manifest);
+
+    for (std::string path; std::getline(in, path);) {
+        try {
+            key = fnv1a(source(path).data(), fnv1a(path, key));
+        } catch (const std::system_error &) {
+            return false;
+        }
+
+        deps.push_back(path);
+    }
+
+    return true;
+}
+
+/* the warnings of a successful compilation are cached with its code, one per line with the line
+ * they refer to in front */
+static std::string write_warnings(const std::vector<cinja::diagnostic> &diagnostics)
+{
+    std::ostringstream out;
+    for (const auto &d : diagnostics)
+        out << d.line << " " << d.message << "\n";
+
+    return out.str();
+}
+
+static std::vector<cinja::diagnostic> read_warnings(const std::string &warnings)
+{
+    std::vector<cinja::diagnostic> diagnostics;
+    std::istringstream in(warnings);
+
+    long line;
+    for (std::string message; in >> line && std::getline(in.ignore(), message);)
+        diagnostics.push_back({cinja::severity::WARNING, line, message});
+
+    return diagnostics;
+}
+
+/* compiles the template at input, or stdin if it is empty, and writes the code to output, or
+ * stdout if it is empty, an output file is left untouched if its content would not change, the
+ * templates that were read are added to deps and written to depfile unless it is empty, returns
+ * the diagnostics of the compilation and throws if a file cannot be read or written */
+static std::vector<cinja::diagnostic> build(const std::string &input, const std::string &output,
+                                            const std::string &depfile, const Cache *cache,
+                                            const cinja::options &options,
+                                            std::vector<std::string> &deps)
+{
+    if (!input.empty())
+        deps.push_back(input);
+
+    std::unique_ptr<source> src;
+    if (!input.empty())
+        src.reset(new source(input));
+    else
+        src.reset(new source(std::cin));
+
+    /* extended templates are found relative to the directory of the template, so the directory is
+     * part of the key of the cache, which covers their contents as they are read */
+    std::string dir = input.substr(0, input.find_last_of('/') + 1);
+    uint64_t key = cache ? fnv1a(dir, Cache::key(src->data(), options_key(options))) : 0;
+    uint64_t manifest_key = fnv1a("extends", key);
+    std::string manifest;
+
+    cinja::options opts = options;
+    opts.load = [&](const std::string &name) {
+        std::string path = !name.empty() && name[0] == '/' ? name : dir + name;
+        std::string data(source(path).data());
+
+        deps.push_back(path);
+        manifest += path + "\n";
+        key = fnv1a(data, fnv1a(path, key));
+        return data;
+    };
+
+    if (!cache && output.empty())
+        return cinja::compile(src->data(), std::cout, opts).diagnostics;
+
+    bool split = !options.sink.empty();
+    cinja::result result;
+    Stats *stats = options.stats;
+
+    uint64_t cached_key = key;
+    std::vector<std::string> cached_deps;
+    std::string warnings;
+    bool hit = cache && cache->lookup(manifest_key, manifest) &&
+               extend_key(cached_key, manifest, cached_deps) &&
+               cache->lookup(cached_key, result.code) &&
+               (!split || cache->lookup(fnv1a("impl", cached_key), result.impl)) &&
+               cache->lookup(fnv1a("warnings", cached_key), warnings);
+
+    if (hit) {
+        deps.insert(deps.end(), cached_deps.begin(), cached_deps.end());
+        result.diagnostics = read_warnings(warnings);
+
+        if (stats) {
+            stats->phase("cache");
+            stats->source_size = src->data().size();
+            stats->code_size = result.code.size() + result.impl.size();
+        }
+    } else {
+        manifest.clear();
+        result = cinja::compile(src->data(), opts);
+        if (!result.ok())
+            return result.diagnostics;
+
+        if (cache) {
+            cache->store(manifest_key, manifest);
+            cache->store(key, result.code);
+            if (split)
+                cache->store(fnv1a("impl", key), result.impl);
+            cache->store(fnv1a("warnings", key), write_warnings(result.diagnostics));
+        }
+    }
+
+    if (output.empty())
+        std::cout << result.code << std::flush;
+    else
+        write_if_changed(output, result.code);
+
+    std::vector<std::string> outputs{output};
+    if (split) {
+        outputs.push_back(impl_path(output));
+        write_if_changed(outputs.back(), result.impl);
+    }
+
+    if (!depfile.empty())
+        write_depfile(depfile, outputs, deps);
+
+    return result.diagnostics;
+}
+
+/* the header for a template is named like the template with the extension replaced by ".h" */
+static std::string output_path(const std::string &dir, const std::string &input)
+{
+    std::string name = input.substr(input.find_last_of('/') + 1);
+    auto dot = name.find_last_of('.');
+
+    if (dot != std::string::npos && dot > 0)
+        name.erase(dot);
+
+    return dir + "/" + name + ".h";
+}
+
+static void read_manifest(const std::string &path, std::vector<std::string> &inputs)
+{
+    std::ifstream in(path);
+    if (!in)
+        throw std::system_error(errno, std::generic_category(), path);
+
+    /* empty lines and lines starting with '#' are skipped */
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line[0] != '#')
+            inputs.push_back(line);
+    }
+}
+
+/* compiles every template in dir and then recompiles a template whenever it or a template it
+ * depends on changes, runs until it is interrupted */
+static void watch(const std::string &dir, const std::string &out_dir, bool depfiles,
+                  const Cache *cache, const cinja::options &options)
+{
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0 ||
+        inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE) < 0)
+        throw std::system_error(errno, std::generic_category(), dir);
+
+    /* the hashes of the files as they were last compiled, so saving a file without changing it
+     * does not trigger a compilation, and the templates that read each file */
+    std::map<std::string, uint64_t> hashes;
+    std::map<std::string, std::set<std::string>> dependents;
+
+    /* only files with the extension of a template are compiled, which leaves out hidden files,
+     * backups of editors, the outputs and the temporary files they are written to */
+    auto is_template = [](const std::string &name) {
+        static const std::set<std::string> extensions{".html", ".htm", ".xml", ".txt", ".j2",
+                                                      ".jinja", ".jinja2"};
+        auto dot = name.find_last_of('.');
+        return name[0] != '.' && dot != std::string::npos && extensions.count(name.substr(dot));
+    };
+
+    /* the outputs are ignored if they are written to the watched directory */
+    struct stat dir_st, out_st;
+    bool in_place = stat(dir.c_str(), &dir_st) == 0 && stat(out_dir.c_str(), &out_st) == 0 &&
+                    dir_st.st_dev == out_st.st_dev && dir_st.st_ino == out_st.st_ino;
+    std::set<std::string> outputs;
+
+    auto outputs_of = [&](const std::string &input) {
+        std::vector<std::string> paths{output_path(out_dir, input)};
+        if (depfiles)
+            paths.push_back(paths[0] + ".d");
+        if (!options.sink.empty())
+            paths.push_back(impl_path(paths[0]));
+        return paths;
+    };
+
+    /* templates that others extend or import are no pages of their own */
+    auto is_library = [&](const std::string &path) { return dependents.count(path) > 0; };
+
+    struct compiled {
+        std::vector<cinja::diagnostic> diagnostics;
+        double ms;
+    };
+
+    auto compile = [&](const std::string &input) {
+        auto start = std::chrono::steady_clock::now();
+        std::string output = output_path(out_dir, input);
+        std::vector<cinja::diagnostic> diagnostics;
+        std::vector<std::string> deps;
+
+        try {
+            diagnostics = build(input, output, depfiles ? output + ".d" : "", cache, options, deps);
+        } catch (const std::exception &e) {
+            diagnostics.push_back({cinja::severity::ERROR, 0, error_message(e)});
+        }
+
+        if (in_place) {
+            for (const auto &path : outputs_of(input))
+                outputs.insert(path.substr(path.find_last_of('/') + 1));
+        }
+
+        /* the template may no longer read what it read before */
+        for (auto it = dependents.begin(); it != dependents.end();) {
+            it->second.erase(input);
+            it = it->second.empty() ? dependents.erase(it) : std::next(it);
+        }
+
+        for (const auto &dep : deps) {
+            if (dep != input)
+                dependents[dep].insert(input);
+        }
+
+        std::chrono::duration<double, std::milli> time = std::chrono::steady_clock::now() - start;
+        return compiled{diagnostics, time.count()};
+    };
+
+    auto report_compiled = [&](const std::string &input, const compiled &result) {
+        bool ok = true;
+        for (const auto &d : result.diagnostics) {
+            report(input + ": ", d);
+            ok = ok && d.level != cinja::severity::ERROR;
+        }
+
+        if (ok)
+            std::cerr << input << ": compiled in " << result.ms << " ms" << std::endl;
+    };
+
+    /* the outputs of templates that turned out to be libraries are removed */
+    auto drop_libraries = [&](const std::set<std::string> &templates) {
+        for (const auto &path : templates) {
+            if (!is_library(path))
+                continue;
+
+            for (const auto &output : outputs_of(path))
+                unlink(output.c_str());
+        }
+    };
+
+    auto changed = [&](const std::string &path) {
+        try {
+            uint64_t hash = fnv1a(source(path).data());
+            auto it = hashes.find(path);
+            if (it != hashes.end() && it->second == hash)
+                return false;
+
+            hashes[path] = hash;
+            return true;
+        } catch (const std::system_error &) {
+            hashes.erase(path);
+            return false;
+        }
+    };
+
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+        throw std::system_error(errno, std::generic_category(), dir);
+
+    std::set<std::string> templates;
+    while (dirent *entry = readdir(d)) {
+        std::string path = dir + "/" + entry->d_name;
+        struct stat st;
+
+        if (is_template(entry->d_name) && stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+            templates.insert(path);
+    }
+    closedir(d);
+
+    /* which templates are libraries is only known once all of them are compiled, so the results
+     * are reported afterwards */
+    std::map<std::string, compiled> results;
+    for (const auto &path : templates) {
+        changed(path);
+        results.emplace(path, compile(path));
+    }
+
+    drop_libraries(templates);
+    for (const auto &path : templates) {
+        if (!is_library(path))
+            report_compiled(path, results.at(path));
+    }
+
+    alignas(inotify_event) char buf[1 << 16];
+    for (;;) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            throw std::system_error(errno, std::generic_category(), dir);
+
+        /* a save often shows up as several events, every template is compiled once per read */
+        std::set<std::string> todo;
+        for (char *p = buf; p < buf + n;) {
+            auto event = reinterpret_cast<const inotify_event *>(p);
+            p += sizeof(inotify_event) + event->len;
+
+            if (event->len == 0 || !is_template(event->name) || outputs.count(event->name))
+                continue;
+
+            std::string path = dir + "/" + event->name;
+            if (event->mask & IN_DELETE) {
+                templates.erase(path);
+                hashes.erase(path);
+
+                /* the templates that read it report that it is gone */
+                auto readers = dependents.find(path);
+                if (readers != dependents.end()) {
+                    todo.insert(readers->second.begin(), readers->second.end());
+                    dependents.erase(readers);
+                }
+
+                for (auto it = dependents.begin(); it != dependents.end();) {
+                    it->second.erase(path);
+                    it = it->second.empty() ? dependents.erase(it) : std::next(it);
+                }
+                continue;
+            }
+
+            templates.insert(path);
+            if (!changed(path))
+                continue;
+
+            todo.insert(path);
+            auto readers = dependents.find(path);
+            if (readers != dependents.end())
+                todo.insert(readers->second.begin(), readers->second.end());
+        }
+
+        for (const auto &path : todo) {
+            if (templates.count(path) && !is_library(path))
+                report_compiled(path, compile(path));
+        }
+
+        drop_libraries(templates);
+    }
+}
+
+/* compiles the templates on a pool of workers, errors are reported for every template in the
+ * order of the inputs and the result is false if any template failed */
+static bool compile_batch(const std::vector<std::string> &inputs, const std::string &dir,
+                          bool depfiles, const Cache *cache, const cinja::options &options,
+                          unsigned workers)
+{
+    std::vector<std::string> outputs;
+    std::set<std::string> seen;
+
+    for (const auto &input : inputs) {
+        outputs.push_back(output_path(dir, input));
+
+        if (!seen.insert(outputs.back()).second)
+            throw std::runtime_error("more than one template compiles to " + outputs.back());
+    }
+
+    std::vector<std::vector<cinja::diagnostic>> diagnostics(inputs.size());
+    std::atomic<size_t> next(0);
+
+    auto work = [&]() {
+        for (size_t i; (i = next++) < inputs.size();) {
+            try {
+                std::vector<std::string> deps;
+                diagnostics[i] = build(inputs[i], outputs[i], depfiles ? outputs[i] + ".d" : "",
+                                       cache, options, deps);
+            } catch (const std::exception &e) {
+                diagnostics[i].push_back({cinja::severity::ERROR, 0, error_message(e)});
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < std::min<size_t>(workers, inputs.size()); ++i)
+        pool.emplace_back(work);
+
+    work();
+
+    for (auto &thread : pool)
+        thread.join();
+
+    bool ok = true;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        for (const auto &d : diagnostics[i]) {
+            report(inputs[i] + ": ", d);
+            ok = ok && d.level != cinja::severity::ERROR;
+        }
+    }
+
+    return ok;
 }
 
 int main(int argc, char *argv[])
 {
     using namespace std;
 
-    ostream *out = &cout;
-    istream *in = &cin;
-    ifstream in_file;
-    ofstream out_file;
-    in_file.exceptions(ios::failbit | ios::badbit);
-    out_file.exceptions(ios::failbit | ios::badbit);
+    string out_path;
+    string out_dir;
+    string depfile;
+    string watch_dir;
+    bool depfiles = false;
+    unique_ptr<Cache> cache;
+    vector<string> inputs;
+    unsigned threads = 0;
+    unique_ptr<Stats> stats;
+    bool stats_json = false;
+    cinja::options options;
 
     try {
+        static const option long_options[] = {{"help", no_argument, nullptr, 'h'},
+                                               {"stats", optional_argument, nullptr, 'S'},
+                                               {"cache", required_argument, nullptr, 'C'},
+                                               {"watch", required_argument, nullptr, 'W'},
+                                               {"sink", required_argument, nullptr, 's'},
+                                               {"param", required_argument, nullptr, 'p'},
+                                               {"include", required_argument, nullptr, 'I'},
+                                               {"eval-budget", required_argument, nullptr, 'E'},
+                                               {"no-optimize", no_argument, nullptr, 'O'},
+                                               {nullptr, 0, nullptr, 0}};
+
         int param;
-        while ((param = getopt(argc, argv, "ho:")) != -1) {
+        while ((param = getopt_long(argc, argv, "ho:d:m:j:M:", long_options, nullptr)) != -1) {
             switch (param) {
             case '?':
                 print_help(cerr, argv[0]);
@@ -34,32 +569,125 @@ int main(int argc, char *argv[])
                 print_help(cout, argv[0]);
                 return EXIT_SUCCESS;
             case 'o':
-                out_file.open(optarg, fstream::out);
-                out = &out_file;
+                out_path = optarg;
+                break;
+            case 'd':
+                out_dir = optarg;
+                break;
+            case 'm':
+                read_manifest(optarg, inputs);
+                break;
+            case 'j':
+                threads = stoul(optarg);
+                if (threads == 0)
+                    threads = max(1u, thread::hardware_concurrency());
+                break;
+            case 'S':
+                if (optarg && string(optarg) != "json") {
+                    print_help(cerr, argv[0]);
+                    return EXIT_FAILURE;
+                }
+                stats.reset(new Stats());
+                stats_json = optarg != nullptr;
+                break;
+            case 'C':
+                cache.reset(new Cache(optarg));
+                break;
+            case 'W':
+                watch_dir = optarg;
+                break;
+            case 's':
+                options.sink = optarg;
+                break;
+            case 'p': {
+                string param(optarg);
+                auto eq = param.find('=');
+                if (eq == string::npos || eq == 0) {
+                    print_help(cerr, argv[0]);
+                    return EXIT_FAILURE;
+                }
+                options.param_types[param.substr(0, eq)] = param.substr(eq + 1);
+                break;
+            }
+            case 'I':
+                options.includes.push_back(optarg);
+                break;
+            case 'E':
+                options.eval_budget = stoul(optarg);
+                break;
+            case 'O':
+                options.optimize = false;
+                break;
+            case 'M':
+                /* -MD and -MF are spelled like the gcc options, the argument of -MF may be
+                 * attached or follow as the next argument */
+                if (optarg == string("D")) {
+                    depfiles = true;
+                } else if (optarg[0] == 'F' && (optarg[1] || optind < argc)) {
+                    depfile = optarg[1] ? optarg + 1 : argv[optind++];
+                    depfiles = true;
+                } else {
+                    print_help(cerr, argv[0]);
+                    return EXIT_FAILURE;
+                }
                 break;
             }
         }
 
-        if (optind < argc) {
-            in_file.open(argv[optind]);
-            in = &in_file;
+        inputs.insert(inputs.end(), argv + optind, argv + argc);
+
+        if (!watch_dir.empty()) {
+            if (out_dir.empty() || !inputs.empty() || !out_path.empty() || !depfile.empty() ||
+                stats)
+                throw runtime_error("--watch needs -d and no templates, -o, -MF or --stats");
+
+            watch(watch_dir, out_dir, depfiles, cache.get(), options);
         }
 
-        string content((istreambuf_iterator<char>(*in)), istreambuf_iterator<char>());
+        if (!out_dir.empty()) {
+            if (!out_path.empty() || !depfile.empty() || stats)
+                throw runtime_error("-o, -MF and --stats cannot be used with -d");
+            if (threads == 0)
+                threads = max(1u, thread::hardware_concurrency());
 
-        tk_vec tokens = tokenize_template(content);
-        tk_iterator it(tokens.begin(), tokens.end());
+            bool ok = compile_batch(inputs, out_dir, depfiles, cache.get(), options, threads);
+            return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
 
-        nptr<> root = parse_template(it);
-        root->validate();
-        root->print(*out) << endl;
+        if (inputs.size() > 1)
+            throw runtime_error("compiling several templates needs an output directory (-d)");
 
-    } catch (const system_error &e) {
-        cerr << "Error: " << e.code().message() << endl;
-        return EXIT_FAILURE;
+        if (depfiles && out_path.empty())
+            throw runtime_error("dependencies can only be written for an output file (-o)");
+        if (depfiles && depfile.empty())
+            depfile = out_path + ".d";
+
+        if (!options.sink.empty() && out_path.empty())
+            throw runtime_error("--sink needs an output file (-o)");
+
+        options.threads = max(1u, threads);
+        options.stats = stats.get();
+
+        vector<string> deps;
+        auto diagnostics = build(inputs.empty() ? "" : inputs.front(), out_path, depfile,
+                                 cache.get(), options, deps);
+
+        bool ok = true;
+        for (const auto &d : diagnostics) {
+            report("", d);
+            ok = ok && d.level != cinja::severity::ERROR;
+        }
+
+        if (!ok)
+            return EXIT_FAILURE;
+
+        if (stats && stats_json)
+            stats->print_json(cerr);
+        else if (stats)
+            stats->print(cerr);
 
     } catch (const exception &e) {
-        cerr << "Error: " << e.what() << endl;
+        cerr << "Error: " << error_message(e) << endl;
         return EXIT_FAILURE;
     }
 
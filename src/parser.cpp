@@ -1,13 +1,32 @@
 #include "parser.h"
+#include "cache.h"
 #include "tokens.h"
+#include <algorithm>
 #include <cassert>
+#include <charconv>
+#include <functional>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <sstream>
 #include <vector>
 
+#ifndef CINJA_VERSION
+#define CINJA_VERSION "unknown"
+#endif
+
 static std::string symbol_prefix("vsym");
 static std::string macro_namespace("macros");
 
+/* the passes over the tree recurse into its nodes, so the nesting of statements and expressions is
+ * limited to keep them from overflowing the stack on any template */
+static const unsigned max_nesting = 512;
+static thread_local unsigned nesting = 0;
+
 ParseException::ParseException(const tk &token, const tk_type_vec &expected)
 {
+    line_ = token.start_line() + 1;
+
     std::stringstream s;
     s << "unexpected token '" << token.value() << "' (" << token.type()->name() << ") on line "
       << (token.start_line() + 1);
@@ -22,6 +41,27 @@ ParseException::ParseException(const tk &token, const tk_type_vec &expected)
     what_ = s.str();
 }
 
+/* counts a level of nesting while it is in scope */
+class NestingGuard
+{
+  public:
+    explicit NestingGuard(const tk &token)
+    {
+        if (nesting == max_nesting) {
+            long line = token.start_line() + 1;
+            throw CompileError("nesting deeper than " + std::to_string(max_nesting) +
+                                   " levels on line " + std::to_string(line),
+                               line);
+        }
+
+        ++nesting;
+    }
+
+    NestingGuard(const NestingGuard &) = delete;
+    NestingGuard &operator=(const NestingGuard &) = delete;
+    ~NestingGuard() { --nesting; }
+};
+
 enum class Associativity { LEFT, RIGHT };
 
 static Associativity binop_associativity(const BinOp op)
@@ -44,7 +84,7 @@ static unsigned binop_precedence(const tk &token, BinOp &op)
 {
     assert(token.type() == tk_types::BIN_OP);
 
-    static std::map<std::string, BinOp> binop{
+    static std::map<std::string_view, BinOp> binop{
         {"-", BinOp::SUB}, {"+", BinOp::ADD},   {"*", BinOp::MUL},   {"/", BinOp::DIV},
         {"<", BinOp::LT},  {">", BinOp::GT},    {"<=", BinOp::LE},   {">=", BinOp::GE},
         {"==", BinOp::EQ}, {"!=", BinOp::NEQ},  {"and", BinOp::AND}, {"or", BinOp::OR},
@@ -81,9 +121,9 @@ static unsigned binop_precedence(const tk &token, BinOp &op)
     return 0;
 }
 
-template <typename T, typename... Args> static std::unique_ptr<T> make_node(Args &&... args)
+template <typename T, typename... Args> static nptr<T> make_node(Arena &arena, Args &&... args)
 {
-    return std::unique_ptr<T>(new T(std::forward<Args>(args)...));
+    return arena.make<T>(std::forward<Args>(args)...);
 }
 
 static void match(tk_iterator &it, tk_type_ptr tk_type, bool consume = true)
@@ -96,15 +136,16 @@ static void match(tk_iterator &it, tk_type_ptr tk_type, bool consume = true)
 }
 
 template <typename T>
-static std::vector<nptr<T>>
-parse_list(tk_iterator &it, std::function<nptr<T>(tk_iterator &)> parse_entry, tk_type_ptr begin,
-           tk_type_ptr end, tk_type_ptr sep = tk_types::COMMA)
+static nlist<nptr<T>> parse_list(tk_iterator &it, Arena &arena,
+                                 std::function<nptr<T>(tk_iterator &, Arena &)> parse_entry,
+                                 tk_type_ptr begin, tk_type_ptr end,
+                                 tk_type_ptr sep = tk_types::COMMA)
 {
     std::vector<nptr<T>> list;
 
     match(it, begin);
     while (it->type() != end) {
-        list.push_back(parse_entry(it));
+        list.push_back(parse_entry(it, arena));
 
         if (it->type() != sep)
             break;
@@ -113,277 +154,723 @@ parse_list(tk_iterator &it, std::function<nptr<T>(tk_iterator &)> parse_entry, t
     }
     match(it, end);
 
-    return list;
+    return arena.list(list);
 }
 
-static nptr<IdNode> parse_var_id(tk_iterator &it)
+std::string symbol_name(std::string_view var) { return symbol_prefix + "_" + std::string(var); }
+
+std::string variable_name(std::string_view symbol)
+{
+    return std::string(symbol.substr(symbol_prefix.size() + 1));
+}
+
+static std::string_view var_name(Arena &arena, std::string_view name)
+{
+    return arena.intern(symbol_name(name));
+}
+
+static nptr<IdNode> parse_var_id(tk_iterator &it, Arena &arena)
 {
     long line = it->start_line();
     match(it, tk_types::IDENTIFIER, false);
-    return make_node<IdNode>(symbol_prefix, (it++)->value(), line);
+    return make_node<IdNode>(arena, var_name(arena, (it++)->value()), line);
 }
 
-static nptr<IdNode> parse_bvar_id(tk_iterator &it)
+static nptr<IdNode> parse_bvar_id(tk_iterator &it, Arena &arena)
 {
     long line = it->start_line();
     match(it, tk_types::IDENTIFIER, false);
-    return make_node<IdNode>(symbol_prefix, (it++)->value(), line, true);
+    return make_node<IdNode>(arena, var_name(arena, (it++)->value()), line, std::string_view(),
+                             true);
 }
 
-static nptr<IdNode> parse_macro_id(tk_iterator &it)
+static std::string_view current_namespace();
+
+static nptr<IdNode> parse_macro_id(tk_iterator &it, Arena &arena,
+                                   std::string_view nspace = current_namespace())
 {
     long line = it->start_line();
     match(it, tk_types::IDENTIFIER, false);
-    return make_node<IdNode>((it++)->value(), line, macro_namespace);
+    return make_node<IdNode>(arena, arena.intern((it++)->value()), line, nspace);
 }
 
-static nptr<IdNode> parse_bmacro_id(tk_iterator &it)
+static nptr<IdNode> parse_bmacro_id(tk_iterator &it, Arena &arena)
 {
     long line = it->start_line();
     match(it, tk_types::IDENTIFIER, false);
-    return make_node<IdNode>((it++)->value(), line, macro_namespace, true);
+    return make_node<IdNode>(arena, arena.intern((it++)->value()), line, current_namespace(),
+                             true);
 }
 
-static nptr<ExprNode> parse_expr(tk_iterator &it, unsigned min_precedence);
-static nptr<ExprNode> parse_rexpr(tk_iterator &it) { return parse_expr(it, 0); }
+static nptr<ExprNode> parse_expr(tk_iterator &it, Arena &arena, unsigned min_precedence);
+static nptr<ExprNode> parse_rexpr(tk_iterator &it, Arena &arena)
+{
+    return parse_expr(it, arena, 0);
+}
 
-static nptr<ExprNode> parse_atom(tk_iterator &it)
+static nptr<ExprNode> parse_atom(tk_iterator &it, Arena &arena)
 {
+    NestingGuard guard(*it);
+
     if (it->type() == tk_types::OPENP) {
-        auto expr = parse_rexpr(++it);
+        auto expr = parse_rexpr(++it, arena);
         match(it, tk_types::CLOSEP);
         return expr;
 
     } else if (it->type() == tk_types::NOT) {
-        auto unop = make_node<UnOpNode>();
+        auto unop = make_node<UnOpNode>(arena);
         unop->op = UnOp::NOT;
-        unop->arg = parse_expr(++it, unop_precedence(UnOp::NOT));
-        return std::move(unop);
+        unop->arg = parse_expr(++it, arena, unop_precedence(UnOp::NOT));
+        return unop;
 
     } else if (it->type() == tk_types::BIN_OP && it->value() == "-") {
-        auto unop = make_node<UnOpNode>();
+        auto unop = make_node<UnOpNode>(arena);
         unop->op = UnOp::NEG;
-        unop->arg = parse_expr(++it, unop_precedence(UnOp::NEG));
-        return std::move(unop);
+        unop->arg = parse_expr(++it, arena, unop_precedence(UnOp::NEG));
+        return unop;
 
     } else if (it->type() == tk_types::NUMBER) {
-        double val = atof(it->value().c_str());
-        auto num = make_node<LiteralNode<double>>(val, (it++)->start_line());
-        return std::move(num);
+        double val = 0;
+        const auto &str = it->value();
+        std::from_chars(str.data(), str.data() + str.size(), val);
+        auto num = make_node<LiteralNode<double>>(arena, val, (it++)->start_line());
+        return num;
 
     } else if (it->type() == tk_types::TRUE) {
         long line = (it++)->start_line();
-        return make_node<LiteralNode<bool>>(true, line);
+        return make_node<LiteralNode<bool>>(arena, true, line);
 
     } else if (it->type() == tk_types::FALSE) {
         long line = (it++)->start_line();
-        return make_node<LiteralNode<bool>>(false, line);
+        return make_node<LiteralNode<bool>>(arena, false, line);
 
     } else if (it->type() == tk_types::STRING) {
         long line = it->start_line();
         const auto &str = (it++)->value();
-        return make_node<LiteralNode<std::string>>(str.substr(1, str.length() - 2), line);
+        return make_node<LiteralNode<std::string_view>>(arena, str.substr(1, str.length() - 2),
+                                                        line);
 
     } else if (it->type() == tk_types::IDENTIFIER) {
-        return parse_var_id(it);
+        return parse_var_id(it, arena);
 
     } else if (it->type() == tk_types::OPENB) {
         return make_node<ListNode>(
-            parse_list<ExprNode>(it, parse_rexpr, tk_types::OPENB, tk_types::CLOSEB));
+            arena, parse_list<ExprNode>(it, arena, parse_rexpr, tk_types::OPENB, tk_types::CLOSEB));
     }
 
     throw ParseException(*it, {tk_types::OPENP, tk_types::NOT, tk_types::BIN_OP, tk_types::NUMBER,
                                tk_types::TRUE, tk_types::FALSE});
 }
 
-static nptr<FieldNode> parse_field(tk_iterator &it)
+static nptr<FieldNode> parse_field(tk_iterator &it, Arena &arena)
 {
     match(it, tk_types::IDENTIFIER, false);
     long line = it->start_line();
-    return make_node<FieldNode>((it++)->value(), line);
+    return make_node<FieldNode>(arena, (it++)->value(), line);
 }
 
 /* parse expressions with the precedence climbing technique */
-static nptr<ExprNode> parse_expr(tk_iterator &it, unsigned min_precedence)
+static nptr<ExprNode> parse_expr(tk_iterator &it, Arena &arena, unsigned min_precedence)
 {
-    auto result = parse_atom(it);
+    auto result = parse_atom(it, arena);
 
     BinOp op;
     unsigned precedence;
 
+    /* a chain of operators is built in a loop and the passes walk it in one, so it is no nesting */
     while (it->type() == tk_types::BIN_OP &&
            (precedence = binop_precedence(*it, op)) >= min_precedence) {
-
         Associativity assoc = binop_associativity(op);
         nptr<ExprNode> rhs;
 
         if (op == BinOp::DOT || op == BinOp::ARROW)
-            rhs = parse_field(++it);
+            rhs = parse_field(++it, arena);
         else if (assoc == Associativity::LEFT)
-            rhs = parse_expr(++it, precedence + 1);
+            rhs = parse_expr(++it, arena, precedence + 1);
         else
-            rhs = parse_expr(++it, precedence);
+            rhs = parse_expr(++it, arena, precedence);
 
-        auto tmp = make_node<BinOpNode>();
+        auto tmp = make_node<BinOpNode>(arena);
         tmp->op = op;
-        tmp->lhs = std::move(result);
-        tmp->rhs = std::move(rhs);
-        result = std::move(tmp);
+        tmp->lhs = result;
+        tmp->rhs = rhs;
+        result = tmp;
     }
 
     return result;
 }
 
-static nptr<StmtNode> parse_statement(tk_iterator &it);
-static nptr<StmtListNode> parse_statement_list(tk_iterator &it)
+/* the tokens of a template that was read from a stream, kept so that its blocks can be parsed
+ * again */
+class tk_list : public tk_source
 {
-    auto node = make_node<StmtListNode>();
+  private:
+    std::vector<tk> tokens_;
+
+  public:
+    void push_back(const tk &token) { tokens_.push_back(token); }
+    tk at(size_t i) override { return i < tokens_.size() ? tokens_[i] : tk(tk_types::EOI, "", 0); }
+};
+
+/* a template of a chain of inheritance with the positions of the bodies of its blocks and of the
+ * tokens after their endblock */
+struct Layer {
+    std::string name;
+    tk_source *tokens;
+    std::map<std::string_view, std::pair<size_t, size_t>> blocks;
+};
+
+/* the templates that are read while one is parsed */
+struct Templates {
+    const Loader &load;
+    std::unique_ptr<tk_list> root;
+    std::map<std::string, std::unique_ptr<tk_store>> files;
+
+    /* the chain from the compiled template to the base that it extends, the blocks are parsed
+     * where the base places them from the definition of the most derived template, so the tree
+     * is flat */
+    std::vector<Layer> layers;
+
+    /* the layer that is scanned for its blocks, or that the parsed tokens belong to */
+    size_t layer = 0;
+    bool scanning = false;
+
+    /* the blocks that are parsed with the layers of their definitions, innermost last */
+    std::vector<std::pair<std::string_view, size_t>> blocks;
+
+    /* the namespace of the macros that are parsed */
+    std::string_view nspace = macro_namespace;
+
+    /* the included and imported templates by their names and namespaces, the templates that are
+     * being read and the namespaces of the aliases of imports */
+    std::map<std::string, std::string_view> libraries;
+    std::vector<nptr<ImportNode>> imports;
+    std::vector<std::string> reading;
+    std::map<std::string_view, std::string_view> aliases;
+};
+
+static thread_local Templates *templates = nullptr;
+
+static std::string_view current_namespace() { return templates->nspace; }
+
+/* whether the tokens start a call of super() in a block */
+static bool at_super(const tk_iterator &it)
+{
+    return templates && !templates->blocks.empty() && it->type() == tk_types::VAR_START &&
+           std::next(it)->type() == tk_types::IDENTIFIER && std::next(it)->value() == "super";
+}
 
-    nptr<StmtNode> stmt;
-    while ((stmt = parse_statement(it)))
-        node->stmts.push_back(std::move(stmt));
+static nptr<StmtNode> parse_statement(tk_iterator &it, Arena &arena);
+static nptr<StmtListNode> parse_block(tk_iterator &it, Arena &arena);
+static nptr<StmtListNode> parse_super(tk_iterator &it, Arena &arena);
+static nptr<StmtListNode> parse_include(tk_iterator &it, Arena &arena);
+static void parse_import(tk_iterator &it, Arena &arena);
 
-    return node;
+/* parses the next statement into stmts, blocks and super() add the statements that they stand for,
+ * returns false if there is no statement */
+static bool parse_statement_into(tk_iterator &it, Arena &arena, std::vector<nptr<StmtNode>> &stmts)
+{
+    nptr<StmtListNode> body;
+
+    if (it->type() == tk_types::BLOCK) {
+        body = parse_block(it, arena);
+    } else if (it->type() == tk_types::INCLUDE) {
+        body = parse_include(it, arena);
+    } else if (it->type() == tk_types::IMPORT) {
+        parse_import(it, arena);
+        return true;
+    } else if (at_super(it)) {
+        body = parse_super(it, arena);
+    } else if (auto stmt = parse_statement(it, arena)) {
+        stmts.push_back(stmt);
+        return true;
+    } else {
+        return false;
+    }
+
+    stmts.insert(stmts.end(), body->stmts.begin(), body->stmts.end());
+    return true;
+}
+
+static nptr<StmtListNode> parse_statement_list(tk_iterator &it, Arena &arena)
+{
+    std::vector<nptr<StmtNode>> stmts;
+
+    while (parse_statement_into(it, arena, stmts))
+        ;
+
+    return make_node<StmtListNode>(arena, arena.list(stmts));
 }
 
-static nptr<IfNode> parse_if(tk_iterator &it)
+/* parses the definition of a block in the given layer */
+static nptr<StmtListNode> parse_definition(Arena &arena, std::string_view name, size_t layer)
 {
-    auto n = make_node<IfNode>();
+    Templates &tpl = *templates;
+    Layer &def = tpl.layers[layer];
+    tk_iterator it(*def.tokens, def.blocks.at(name).first);
+
+    size_t outer = tpl.layer;
+    tpl.layer = layer;
+    tpl.blocks.push_back({name, layer});
+
+    auto body = parse_statement_list(it, arena);
+
+    tpl.blocks.pop_back();
+    tpl.layer = outer;
+    return body;
+}
+
+static void parse_endblock(tk_iterator &it, std::string_view name)
+{
+    match(it, tk_types::ENDBLOCK);
+
+    /* the name may be repeated after endblock */
+    if (it->type() == tk_types::IDENTIFIER) {
+        if (it->value() != name) {
+            long line = it->start_line() + 1;
+            throw CompileError("endblock '" + std::string(it->value()) + "' closes block '" +
+                                   std::string(name) + "' on line " + std::to_string(line),
+                               line);
+        }
+
+        ++it;
+    }
+}
+
+/* returns the statements of the most derived definition of a block */
+static nptr<StmtListNode> parse_block(tk_iterator &it, Arena &arena)
+{
+    NestingGuard guard(*it);
+    Templates &tpl = *templates;
+    long line = it->start_line() + 1;
+
+    match(it, tk_types::BLOCK);
+    match(it, tk_types::IDENTIFIER, false);
+    std::string_view name = (it++)->value();
+    size_t begin = it.position();
+
+    /* the blocks of a template that extends no other are printed where they are */
+    if (tpl.layers.empty() || tpl.scanning) {
+        tpl.blocks.push_back({name, tpl.layer});
+        auto body = parse_statement_list(it, arena);
+        tpl.blocks.pop_back();
+        parse_endblock(it, name);
+
+        if (tpl.scanning &&
+            !tpl.layers[tpl.layer].blocks.emplace(name, std::make_pair(begin, it.position())).second)
+            throw CompileError("block '" + std::string(name) + "' is defined twice on line " +
+                                   std::to_string(line),
+                               line);
+
+        return body;
+    }
+
+    /* the definition here is skipped for the one of the most derived template */
+    Layer &own = tpl.layers[tpl.layer];
+    it = tk_iterator(*own.tokens, own.blocks.at(name).second);
+
+    size_t layer = 0;
+    while (!tpl.layers[layer].blocks.count(name))
+        ++layer;
+
+    return parse_definition(arena, name, layer);
+}
+
+/* returns the statements of the definition that the innermost block being parsed overrides */
+static nptr<StmtListNode> parse_super(tk_iterator &it, Arena &arena)
+{
+    NestingGuard guard(*it);
+    Templates &tpl = *templates;
+    long line = it->start_line() + 1;
+
+    match(it, tk_types::VAR_START);
+    match(it, tk_types::IDENTIFIER);
+    match(it, tk_types::OPENP);
+    match(it, tk_types::CLOSEP);
+    match(it, tk_types::VAR_END);
+
+    if (tpl.scanning)
+        return make_node<StmtListNode>(arena);
+
+    auto block = tpl.blocks.back();
+    for (size_t layer = block.second + 1; layer < tpl.layers.size(); ++layer) {
+        if (tpl.layers[layer].blocks.count(block.first))
+            return parse_definition(arena, block.first, layer);
+    }
+
+    throw CompileError("block '" + std::string(block.first) +
+                           "' overrides no block for super() on line " + std::to_string(line),
+                       line);
+}
+
+static nptr<IfNode> parse_if(tk_iterator &it, Arena &arena)
+{
+    auto n = make_node<IfNode>(arena);
 
     match(it, tk_types::IF);
-    n->condition = parse_rexpr(it);
-    n->body = parse_statement_list(it);
+    n->condition = parse_rexpr(it, arena);
+    n->body = parse_statement_list(it, arena);
 
-    auto tail = n.get();
+    auto tail = n;
     while (it->type() == tk_types::ELIF) {
-        auto elif = make_node<IfNode>();
-        auto elif_ptr = elif.get();
+        auto elif = make_node<IfNode>(arena);
 
-        elif->condition = parse_rexpr(++it);
-        elif->body = parse_statement_list(it);
+        elif->condition = parse_rexpr(++it, arena);
+        elif->body = parse_statement_list(it, arena);
 
-        tail->elze = make_node<StmtListNode>();
-        tail->elze->stmts.push_back(std::move(elif));
-        tail = elif_ptr;
+        tail->elze = make_node<StmtListNode>(arena, arena.list<nptr<StmtNode>>({elif}));
+        tail = elif;
     }
 
     if (it->type() == tk_types::ELSE)
-        tail->elze = parse_statement_list(++it);
+        tail->elze = parse_statement_list(++it, arena);
     else
-        tail->elze = make_node<StmtListNode>();
+        tail->elze = make_node<StmtListNode>(arena);
 
     match(it, tk_types::ENDIF);
     return n;
 }
 
-static nptr<StmtNode> parse_interpolation(tk_iterator &it)
+static nptr<StmtNode> parse_interpolation(tk_iterator &it, Arena &arena)
 {
     match(it, tk_types::VAR_START);
 
+    /* the macros of an import are called through its alias */
+    std::string_view nspace = current_namespace();
+    if (it->type() == tk_types::IDENTIFIER && std::next(it)->type() == tk_types::BIN_OP &&
+        std::next(it)->value() == "." && templates->aliases.count(it->value())) {
+        nspace = templates->aliases[it->value()];
+        ++++it;
+        match(it, tk_types::IDENTIFIER, false);
+    }
+
     if (it->type() == tk_types::IDENTIFIER && std::next(it)->type() == tk_types::OPENP) {
-        auto call = make_node<CallNode>();
+        auto call = make_node<CallNode>(arena);
 
-        call->id = parse_macro_id(it);
-        call->args = parse_list<ExprNode>(it, parse_rexpr, tk_types::OPENP, tk_types::CLOSEP);
+        call->id = parse_macro_id(it, arena, nspace);
+        call->args =
+            parse_list<ExprNode>(it, arena, parse_rexpr, tk_types::OPENP, tk_types::CLOSEP);
 
         match(it, tk_types::VAR_END);
-        return std::move(call);
+        return call;
     } else {
-        auto var = make_node<VarNode>();
-        var->expr = parse_rexpr(it);
+        auto var = make_node<VarNode>(arena);
+        var->expr = parse_rexpr(it, arena);
         match(it, tk_types::VAR_END);
-        return std::move(var);
+        return var;
     }
 }
 
-static nptr<ArgumentNode> parse_arg(tk_iterator &it)
+static nptr<ArgumentNode> parse_arg(tk_iterator &it, Arena &arena)
 {
-    auto node = make_node<ArgumentNode>();
-    node->id = parse_bvar_id(it);
+    auto node = make_node<ArgumentNode>(arena);
+    node->id = parse_bvar_id(it, arena);
 
     if (it->type() == tk_types::ASSIGNMENT) {
         match(it, tk_types::ASSIGNMENT);
-        node->dflt = parse_rexpr(it);
+        node->dflt = parse_rexpr(it, arena);
     }
 
     return node;
 }
 
-static nptr<StmtNode> parse_statement(tk_iterator &it)
+static nptr<StmtNode> parse_statement(tk_iterator &it, Arena &arena)
 {
+    NestingGuard guard(*it);
+
     if (it->type() == tk_types::CONTENT) {
-        auto n = make_node<ContentNode>();
+        auto n = make_node<ContentNode>(arena);
         n->content = (it++)->value();
-        return std::move(n);
+        return n;
 
     } else if (it->type() == tk_types::IF) {
-        return parse_if(it);
+        return parse_if(it, arena);
 
     } else if (it->type() == tk_types::FOR) {
-        auto n = make_node<ForNode>();
+        auto n = make_node<ForNode>(arena);
 
-        n->var = parse_bvar_id(++it);
+        n->var = parse_bvar_id(++it, arena);
         match(it, tk_types::IN);
-        n->collection = parse_rexpr(it);
+        n->collection = parse_rexpr(it, arena);
 
         if (it->type() == tk_types::FILTER)
-            n->filter = parse_rexpr(++it);
+            n->filter = parse_rexpr(++it, arena);
         else
-            n->filter = make_node<LiteralNode<bool>>(true, it->start_line());
+            n->filter = make_node<LiteralNode<bool>>(arena, true, it->start_line());
 
-        n->body = parse_statement_list(it);
+        n->body = parse_statement_list(it, arena);
         match(it, tk_types::ENDFOR);
-        return std::move(n);
+        return n;
 
     } else if (it->type() == tk_types::VAR_START) {
-        return parse_interpolation(it);
+        return parse_interpolation(it, arena);
 
     } else if (it->type() == tk_types::SET) {
-        auto n = make_node<SetNode>();
+        auto n = make_node<SetNode>(arena);
 
-        n->var = parse_bvar_id(++it);
+        n->var = parse_bvar_id(++it, arena);
         match(it, tk_types::ASSIGNMENT);
-        n->value = parse_rexpr(it);
-        n->body = parse_statement_list(it);
+        n->value = parse_rexpr(it, arena);
+        n->body = parse_statement_list(it, arena);
 
-        return std::move(n);
+        return n;
     }
 
     return nullptr;
 }
 
-static nptr<StmtListNode> parse_rstatement_list(tk_iterator &it,
+static nptr<MacroNode> parse_macro(tk_iterator &it, Arena &arena)
+{
+    auto m = make_node<MacroNode>(arena);
+
+    m->id = parse_bmacro_id(++it, arena);
+    m->args =
+        parse_list<ArgumentNode>(it, arena, parse_arg, tk_types::OPENP, tk_types::CLOSEP);
+    m->body = parse_statement_list(it, arena);
+
+    match(it, tk_types::ENDMACRO);
+    return m;
+}
+
+static nptr<StmtListNode> parse_rstatement_list(tk_iterator &it, Arena &arena,
                                                 std::vector<nptr<MacroNode>> &macros)
 {
-    auto stmts = make_node<StmtListNode>();
+    std::vector<nptr<StmtNode>> stmts;
+
+    for (;;) {
+        if (it->type() == tk_types::MACRO)
+            macros.push_back(parse_macro(it, arena));
+        else if (!parse_statement_into(it, arena, stmts))
+            break;
+    }
+
+    return make_node<StmtListNode>(arena, arena.list(stmts));
+}
+
+/* returns the tokens of a template that is read by its name, every template is read once */
+static tk_store &read_template(const std::string &name, long line)
+{
+    Templates &tpl = *templates;
+
+    auto &file = tpl.files[name];
+    if (!file) {
+        if (!tpl.load)
+            throw CompileError("template '" + name + "' cannot be loaded on line " +
+                                   std::to_string(line),
+                               line);
+
+        file = std::make_unique<tk_store>(tokenize_template(tpl.load(name)));
+    }
+
+    return *file;
+}
+
+/* returns the name of a template in the string after the token at it */
+static std::string parse_template_name(tk_iterator &it, tk_type_ptr tk_type, long &line)
+{
+    match(it, tk_type);
+    match(it, tk_types::STRING, false);
+    line = it->start_line() + 1;
+
+    auto value = (it++)->value();
+    return std::string(value.substr(1, value.size() - 2));
+}
+
+/* parses an included or imported template, its macros are declared in a namespace named by the
+ * hash of its source, which the generated code renames by the hash of their code, and added to the
+ * imports once, returns the namespace and the body, which sees the variables of the place it is
+ * parsed at */
+static std::pair<std::string_view, nptr<StmtListNode>> parse_library(Arena &arena,
+                                                                     const std::string &name,
+                                                                     long line)
+{
+    Templates &tpl = *templates;
+
+    if (std::find(tpl.reading.begin(), tpl.reading.end(), name) != tpl.reading.end())
+        throw CompileError("template '" + name + "' includes itself on line " +
+                               std::to_string(line),
+                           line);
+
+    tk_store &tokens = read_template(name, line);
+    std::string_view source = tokens.source();
+    uint64_t hash = fnv1a(source, fnv1a(CINJA_VERSION));
+
+    std::ostringstream nspace;
+    nspace << macro_namespace << "_" << std::hex << std::setw(16) << std::setfill('0') << hash;
+
+    /* the blocks of the library are its own, so the state of the inheritance is put aside */
+    Templates outer{tpl.load};
+    std::swap(outer.layers, tpl.layers);
+    std::swap(outer.blocks, tpl.blocks);
+    std::swap(outer.layer, tpl.layer);
+    std::swap(outer.scanning, tpl.scanning);
+    std::swap(outer.nspace, tpl.nspace);
+
+    tpl.nspace = arena.intern(nspace.str());
+    tpl.reading.push_back(name);
+
+    std::vector<nptr<MacroNode>> macros;
+    tk_iterator it(tokens);
+    auto body = parse_rstatement_list(it, arena, macros);
+    match(it, tk_types::EOI);
+
+    tpl.reading.pop_back();
+    auto result = std::make_pair(tpl.nspace, body);
+
+    std::swap(outer.layers, tpl.layers);
+    std::swap(outer.blocks, tpl.blocks);
+    std::swap(outer.layer, tpl.layer);
+    std::swap(outer.scanning, tpl.scanning);
+    std::swap(outer.nspace, tpl.nspace);
+
+    /* templates with the same source share their macros */
+    bool known = false;
+    for (const auto &import : tpl.imports)
+        known = known || import->nspace == result.first;
+
+    if (!known) {
+        auto import = make_node<ImportNode>(arena);
+        import->nspace = result.first;
+        import->macros = arena.list(macros);
+        tpl.imports.push_back(import);
+    }
+
+    tpl.libraries[name] = result.first;
+    return result;
+}
+
+/* returns the body of an included template */
+static nptr<StmtListNode> parse_include(tk_iterator &it, Arena &arena)
+{
+    NestingGuard guard(*it);
+    long line;
+
+    std::string name = parse_template_name(it, tk_types::INCLUDE, line);
+    return parse_library(arena, name, line).second;
+}
+
+/* makes the macros of an imported template callable through an alias */
+static void parse_import(tk_iterator &it, Arena &arena)
+{
+    NestingGuard guard(*it);
+    long line;
+
+    std::string name = parse_template_name(it, tk_types::IMPORT, line);
+    match(it, tk_types::AS);
+    match(it, tk_types::IDENTIFIER, false);
+    std::string_view alias = (it++)->value();
+
+    auto known = templates->libraries.find(name);
+    std::string_view nspace = known != templates->libraries.end()
+                                  ? known->second
+                                  : parse_library(arena, name, line).first;
+
+    templates->aliases[alias] = nspace;
+}
+
+/* whether a template extends another, content in front of extends is printed like in jinja */
+static bool at_extends(const tk_iterator &it)
+{
+    return it->type() == tk_types::EXTENDS ||
+           (it->type() == tk_types::CONTENT && std::next(it)->type() == tk_types::EXTENDS);
+}
+
+/* records the blocks of a template that extends another and returns the name of the other one,
+ * statements outside of blocks are ignored like in jinja */
+static std::string scan_derived(tk_iterator &it, Arena &arena, std::vector<nptr<StmtNode>> &prefix,
+                                std::vector<nptr<MacroNode>> &macros, long &line)
+{
+    if (it->type() == tk_types::CONTENT)
+        prefix.push_back(parse_statement(it, arena));
+
+    std::string name = parse_template_name(it, tk_types::EXTENDS, line);
+
+    for (;;) {
+        if (it->type() == tk_types::CONTENT)
+            ++it;
+        else if (it->type() == tk_types::MACRO)
+            macros.push_back(parse_macro(it, arena));
+        else if (it->type() == tk_types::BLOCK)
+            parse_block(it, arena);
+        else if (it->type() == tk_types::IMPORT)
+            parse_import(it, arena);
+        else if (it->type() == tk_types::EOI)
+            return name;
+        else
+            throw ParseException(*it, {tk_types::BLOCK, tk_types::MACRO, tk_types::IMPORT});
+    }
+}
+
+/* loads the chain of templates that the remaining tokens extend and returns the flat body */
+static nptr<StmtListNode> parse_inheritance(tk_iterator &it, Arena &arena,
+                                            std::vector<nptr<MacroNode>> &macros)
+{
+    Templates &tpl = *templates;
+    std::vector<nptr<StmtNode>> stmts;
+
+    auto tokens = std::make_unique<tk_list>();
+    for (; it->type() != tk_types::EOI; ++it)
+        tokens->push_back(*it);
+
+    tpl.layers.push_back({"", tokens.get(), {}});
+    tpl.root = std::move(tokens);
+    tpl.scanning = true;
 
     for (;;) {
-        if (it->type() == tk_types::MACRO) {
-            auto m = make_node<MacroNode>();
-
-            m->id = parse_bmacro_id(++it);
-            m->args = parse_list<ArgumentNode>(it, parse_arg, tk_types::OPENP, tk_types::CLOSEP);
-            m->body = parse_statement_list(it);
-
-            match(it, tk_types::ENDMACRO);
-            macros.push_back(std::move(m));
-        } else {
-            nptr<StmtNode> stmt = parse_statement(it);
-
-            if (stmt)
-                stmts->stmts.push_back(std::move(stmt));
-            else
-                break;
+        tpl.layer = tpl.layers.size() - 1;
+        tk_iterator derived(*tpl.layers.back().tokens);
+        if (!at_extends(derived))
+            break;
+
+        long line;
+        std::string name = scan_derived(derived, arena, stmts, macros, line);
+
+        for (const auto &layer : tpl.layers) {
+            if (layer.name == name)
+                throw CompileError("template '" + name + "' extends itself on line " +
+                                       std::to_string(line),
+                                   line);
         }
+
+        tpl.layers.push_back({name, &read_template(name, line), {}});
     }
 
-    return stmts;
+    /* the base is scanned before it is parsed, so that the blocks it defines are known to super()
+     * wherever they are */
+    std::vector<nptr<MacroNode>> scanned;
+    tk_iterator base(*tpl.layers.back().tokens);
+    parse_rstatement_list(base, arena, scanned);
+    match(base, tk_types::EOI);
+
+    tpl.scanning = false;
+    base = tk_iterator(*tpl.layers.back().tokens);
+    auto body = parse_rstatement_list(base, arena, macros);
+    match(base, tk_types::EOI);
+
+    stmts.insert(stmts.end(), body->stmts.begin(), body->stmts.end());
+    return make_node<StmtListNode>(arena, arena.list(stmts));
 }
 
-nptr<> parse_template(tk_iterator &it)
+nptr<TemplateNode> parse_template(tk_iterator &it, Arena &arena, const Loader &load)
 {
-    auto root = make_node<TemplateNode>();
-    root->body = parse_rstatement_list(it, root->macros);
+    std::vector<nptr<MacroNode>> macros;
+    auto root = make_node<TemplateNode>(arena);
+
+    /* the parser reaches the state of the templates like the nesting */
+    Templates tpl{load};
+    struct Scope {
+        Templates *outer = templates;
+        explicit Scope(Templates &tpl) { templates = &tpl; }
+        ~Scope() { templates = outer; }
+    } scope(tpl);
+
+    if (at_extends(it))
+        root->body = parse_inheritance(it, arena, macros);
+    else
+        root->body = parse_rstatement_list(it, arena, macros);
+
+    root->macros = arena.list(macros);
+    root->imports = arena.list(tpl.imports);
     match(it, tk_types::EOI);
-    return std::move(root);
+    return root;
 }
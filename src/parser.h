@@ -1,20 +1,27 @@
 #pragma once
 #include "ast.h"
+#include "diagnostic.h"
 #include "lexer.h"
+#include <functional>
 #include <iostream>
 #include <map>
 #include <memory>
 #include <string>
 #include <vector>
 
-class ParseException : public std::exception
+class ParseException : public CompileError
 {
-  private:
-    std::string what_;
-
   public:
     ParseException(const tk &token, const tk_type_vec &expected);
-    const char *what() const noexcept override { return what_.c_str(); }
 };
 
-nptr<> parse_template(tk_iterator &it);
+/* returns the name of a template variable in the generated code and the reverse */
+std::string symbol_name(std::string_view var);
+std::string variable_name(std::string_view symbol);
+
+/* returns the source of the template with the given name, which has to outlive the tree */
+typedef std::function<std::string_view(std::string_view name)> Loader;
+
+/* the nodes are allocated in the arena, which has to outlive them, the templates a template
+ * extends are read with the loader and their blocks are merged into one flat tree */
+nptr<TemplateNode> parse_template(tk_iterator &it, Arena &arena, const Loader &load = Loader());
@@ -0,0 +1,137 @@
+#include "ast.h"
+
+void IdNode::resolve(SymbolTable &syms)
+{
+    sym = nspace.empty() ? syms.intern(name) : syms.intern(full_name());
+
+    if (!binding)
+        syms.use(sym);
+}
+
+void StmtListNode::resolve(SymbolTable &syms)
+{
+    for (const auto &stmt : stmts)
+        stmt->resolve(syms);
+}
+
+void ForNode::resolve(SymbolTable &syms)
+{
+    var->resolve(syms);
+    collection->resolve(syms);
+
+    syms.bind(var->sym);
+    filter->resolve(syms);
+    body->resolve(syms);
+    syms.unbind(var->sym);
+}
+
+void IfNode::resolve(SymbolTable &syms)
+{
+    condition->resolve(syms);
+    body->resolve(syms);
+    elze->resolve(syms);
+}
+
+void SetNode::resolve(SymbolTable &syms)
+{
+    var->resolve(syms);
+    declares = !syms.bound(var->sym);
+    if (!declares)
+        syms.reassign(var->sym);
+    value->resolve(syms);
+
+    syms.bind(var->sym);
+    body->resolve(syms);
+    syms.unbind(var->sym);
+}
+
+void ListNode::resolve(SymbolTable &syms)
+{
+    for (const auto &value : values)
+        value->resolve(syms);
+}
+
+void VarNode::resolve(SymbolTable &syms) { expr->resolve(syms); }
+
+void UnOpNode::resolve(SymbolTable &syms) { arg->resolve(syms); }
+
+void BinOpNode::resolve(SymbolTable &syms)
+{
+    auto ops = chain(this);
+    ops.front()->lhs->resolve(syms);
+
+    for (const auto &op : ops)
+        op->rhs->resolve(syms);
+}
+
+void CallNode::resolve(SymbolTable &syms)
+{
+    id->resolve(syms);
+
+    for (const auto &arg : args)
+        arg->resolve(syms);
+}
+
+void ArgumentNode::resolve(SymbolTable &syms)
+{
+    id->resolve(syms);
+
+    if (dflt)
+        dflt->resolve(syms);
+}
+
+void MacroNode::resolve(SymbolTable &syms)
+{
+    id->resolve(syms);
+
+    for (const auto &arg : args)
+        arg->resolve(syms);
+
+    for (const auto &arg : args)
+        syms.bind(arg->id->sym);
+
+    body->resolve(syms);
+
+    for (const auto &arg : args)
+        syms.unbind(arg->id->sym);
+
+    auto free = syms.take_free();
+    closed = free.empty();
+
+    for (const auto &sym : free) {
+        syms.warnings.push_back({cinja::severity::WARNING, id->begin_line() + 1,
+                                 "Unknown symbol '" + std::string(sym) + "' in macro '" +
+                                     std::string(id->name) + "'"});
+    }
+}
+
+void ImportNode::resolve(SymbolTable &syms)
+{
+    for (const auto &macro : macros)
+        macro->resolve(syms);
+}
+
+void TemplateNode::resolve(SymbolTable &syms)
+{
+    /* macros can be called before they are defined, also those of one import by another */
+    for (const auto &import : imports) {
+        for (const auto &macro : import->macros) {
+            macro->id->resolve(syms);
+            syms.bind(macro->id->sym);
+        }
+    }
+
+    for (const auto &macro : macros) {
+        macro->id->resolve(syms);
+        syms.bind(macro->id->sym);
+    }
+
+    for (const auto &import : imports)
+        import->resolve(syms);
+
+    for (const auto &macro : macros)
+        macro->resolve(syms);
+
+    body->resolve(syms);
+    params = syms.take_free();
+}
@@ -0,0 +1,70 @@
+#include "source.h"
+#include <fcntl.h>
+#include <iterator>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+static std::system_error errno_error(const std::string &what)
+{
+    return std::system_error(errno, std::generic_category(), what);
+}
+
+source::source(const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw errno_error(path);
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        auto e = errno_error(path);
+        close(fd);
+        throw e;
+    }
+
+    /* pipes and other special files cannot be mapped */
+    if (!S_ISREG(st.st_mode)) {
+        char buf[1 << 16];
+        ssize_t n;
+
+        while ((n = read(fd, buf, sizeof(buf))) > 0)
+            buffer_.append(buf, n);
+
+        close(fd);
+        if (n < 0)
+            throw errno_error(path);
+
+        data_ = buffer_;
+        return;
+    }
+
+    size_ = st.st_size;
+    if (size_ > 0) {
+        map_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (map_ == MAP_FAILED) {
+            auto e = errno_error(path);
+            close(fd);
+            throw e;
+        }
+
+        madvise(map_, size_, MADV_SEQUENTIAL);
+        data_ = std::string_view(static_cast<const char *>(map_), size_);
+    }
+
+    close(fd);
+}
+
+source::source(std::istream &in)
+    : buffer_((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>()),
+      data_(buffer_)
+{
+}
+
+source::~source()
+{
+    if (map_)
+        munmap(map_, size_);
+}
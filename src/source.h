@@ -0,0 +1,25 @@
+#pragma once
+#include <istream>
+#include <string>
+#include <string_view>
+
+/* the raw bytes of a template, files are mapped into memory and other streams are read into a
+ * buffer, tokens and ast nodes refer to it so it has to outlive both */
+class source
+{
+  private:
+    std::string buffer_;
+    void *map_ = nullptr;
+    size_t size_ = 0;
+    std::string_view data_;
+
+  public:
+    explicit source(const std::string &path);
+    explicit source(std::istream &in);
+
+    source(const source &) = delete;
+    source &operator=(const source &) = delete;
+    ~source();
+
+    std::string_view data() const { return data_; }
+};
@@ -0,0 +1,219 @@
+#include "stats.h"
+#include "validate.h"
+#include <iomanip>
+#include <sys/resource.h>
+
+counting_buf::int_type counting_buf::overflow(int_type c)
+{
+    if (traits_type::eq_int_type(c, traits_type::eof()))
+        return traits_type::not_eof(c);
+
+    ++count_;
+    return dest_->sputc(traits_type::to_char_type(c));
+}
+
+std::streamsize counting_buf::xsputn(const char *s, std::streamsize n)
+{
+    auto written = dest_->sputn(s, n);
+    count_ += written;
+    return written;
+}
+
+void Stats::phase(const std::string &name)
+{
+    auto now = std::chrono::steady_clock::now();
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    phases.push_back({name, std::chrono::duration<double>(now - mark_).count(), usage.ru_maxrss});
+    mark_ = now;
+}
+
+void Stats::count_tokens(const tk_store &store)
+{
+    for (size_t i = 0; i < store.size(); ++i)
+        ++tokens[store.type(i)->name()];
+}
+
+void Stats::count_nodes(const Node &root)
+{
+    NodeCounts counts;
+    root.count(counts);
+
+    for (const auto &count : counts)
+        nodes[demangle(count.first.name())] += count.second;
+}
+
+void Stats::print(std::ostream &o) const
+{
+    o << std::fixed << std::setprecision(3);
+    o << std::left << std::setw(12) << "phase" << std::right << std::setw(12) << "time [ms]"
+      << std::setw(16) << "peak rss [KiB]\n";
+
+    for (const auto &phase : phases) {
+        o << std::left << std::setw(12) << phase.name << std::right << std::setw(12)
+          << phase.seconds * 1000 << std::setw(15) << phase.peak_rss_kb << "\n";
+    }
+
+    o << "\ntokens:\n";
+    for (const auto &count : tokens)
+        o << "\t" << std::left << std::setw(20) << count.first << " " << count.second << "\n";
+
+    o << "\nnodes:\n";
+    for (const auto &count : nodes)
+        o << "\t" << std::left << std::setw(40) << count.first << " " << count.second << "\n";
+
+    o << "\nsource size: " << source_size << " bytes\n";
+    o << "code size:   " << code_size << " bytes\n";
+}
+
+/* the names of token types and node classes never need to be escaped */
+template <typename T> static void print_json_counts(std::ostream &o, const T &counts)
+{
+    o << "{";
+
+    for (auto it = counts.begin(); it != counts.end(); ++it) {
+        if (it != counts.begin())
+            o << ", ";
+        o << "\"" << it->first << "\": " << it->second;
+    }
+
+    o << "}";
+}
+
+void Stats::print_json(std::ostream &o) const
+{
+    o << std::setprecision(9);
+    o << "{\"phases\": [";
+
+    for (size_t i = 0; i < phases.size(); ++i) {
+        if (i > 0)
+            o << ", ";
+        o << "{\"name\": \"" << phases[i].name << "\", \"seconds\": " << phases[i].seconds
+          << ", \"peak_rss_kb\": " << phases[i].peak_rss_kb << "}";
+    }
+
+    o << "], \"tokens\": ";
+    print_json_counts(o, tokens);
+    o << ", \"nodes\": ";
+    print_json_counts(o, nodes);
+    o << ", \"source_size\": " << source_size << ", \"code_size\": " << code_size << "}\n";
+}
+
+void StmtListNode::count(NodeCounts &counts) const
+{
+    ++counts[typeid(*this)];
+
+    for (const auto &stmt : stmts)
+        stmt->count(counts);
+}
+
+void FieldNode::count(NodeCounts &counts) const { ++counts[typeid(*this)]; }
+void IdNode::count(NodeCounts &counts) const { ++counts[typeid(*this)]; }
+void ContentNode::count(NodeCounts &counts) const { ++counts[typeid(*this)]; }
+
+void ForNode::count(NodeCounts &counts) const
+{
+    ++counts[typeid(*this)];
+    var->count(counts);
+    collection->count(counts);
+    filter->count(counts);
+    body->count(counts);
+}
+
+void SetNode::count(NodeCounts &counts) const
+{
+    ++counts[typeid(*this)];
+    var->count(counts);
+    value->count(counts);
+    body->count(counts);
+}
+
+void ListNode::count(NodeCounts &counts) const
+{
+    ++counts[typeid(*this)];
+
+    for (const auto &value : values)
+        value->count(counts);
+}
+
+void IfNode::count(NodeCounts &counts) const
+{
+    ++counts[typeid(*this)];
+    condition->count(counts);
+    body->count(counts);
+    elze->count(counts);
+}
+
+void VarNode::count(NodeCounts &counts) const
+{
+    ++counts[typeid(*this)];
+    expr->count(counts);
+}
+
+void UnOpNode::count(NodeCounts &counts) const
+{
+    ++counts[typeid(*this)];
+    arg->count(counts);
+}
+
+void BinOpNode::count(NodeCounts &counts) const
+{
+    auto ops = chain(this);
+    ops.front()->lhs->count(counts);
+
+    for (const auto &op : ops) {
+        ++counts[typeid(*op)];
+        op->rhs->count(counts);
+    }
+}
+
+void CallNode::count(NodeCounts &counts) const
+{
+    ++counts[typeid(*this)];
+    id->count(counts);
+
+    for (const auto &arg : args)
+        arg->count(counts);
+}
+
+void ArgumentNode::count(NodeCounts &counts) const
+{
+    ++counts[typeid(*this)];
+    id->count(counts);
+
+    if (dflt)
+        dflt->count(counts);
+}
+
+void MacroNode::count(NodeCounts &counts) const
+{
+    ++counts[typeid(*this)];
+    id->count(counts);
+
+    for (const auto &arg : args)
+        arg->count(counts);
+
+    body->count(counts);
+}
+
+void ImportNode::count(NodeCounts &counts) const
+{
+    ++counts[typeid(*this)];
+
+    for (const auto &macro : macros)
+        macro->count(counts);
+}
+
+void TemplateNode::count(NodeCounts &counts) const
+{
+    ++counts[typeid(*this)];
+
+    for (const auto &import : imports)
+        import->count(counts);
+
+    for (const auto &macro : macros)
+        macro->count(counts);
+
+    body->count(counts);
+}
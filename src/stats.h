@@ -0,0 +1,58 @@
+#pragma once
+#include "ast.h"
+#include "token.h"
+#include <chrono>
+#include <map>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+/* forwards everything written to another buffer and counts the bytes */
+class counting_buf : public std::streambuf
+{
+  private:
+    std::streambuf *dest_;
+    size_t count_ = 0;
+
+  protected:
+    int_type overflow(int_type c) override;
+    std::streamsize xsputn(const char *s, std::streamsize n) override;
+    int sync() override { return dest_->pubsync(); }
+
+  public:
+    explicit counting_buf(std::streambuf *dest) : dest_(dest) {}
+
+    size_t count() const { return count_; }
+};
+
+/* wall time and peak memory of the compiler phases together with the sizes of their results */
+class Stats
+{
+  public:
+    struct Phase {
+        std::string name;
+        double seconds;
+        long peak_rss_kb;
+    };
+
+    std::vector<Phase> phases;
+    std::map<std::string, size_t> tokens;
+    std::map<std::string, size_t> nodes;
+    size_t source_size = 0;
+    size_t code_size = 0;
+
+    Stats() : mark_(std::chrono::steady_clock::now()) {}
+
+    /* records the time since the previous phase ended and the peak memory so far */
+    void phase(const std::string &name);
+
+    void count_tokens(const tk_store &store);
+    void count_nodes(const Node &root);
+
+    void print(std::ostream &o) const;
+    void print_json(std::ostream &o) const;
+
+  private:
+    std::chrono::steady_clock::time_point mark_;
+};
@@ -0,0 +1,39 @@
+#include "symtab.h"
+#include <algorithm>
+
+sym_id SymbolTable::intern(std::string_view name)
+{
+    auto it = ids_.find(name);
+    if (it != ids_.end())
+        return it->second;
+
+    name = arena_.intern(name);
+    ids_.emplace(name, names_.size());
+    names_.push_back(name);
+    bindings_.push_back(0);
+    used_.push_back(false);
+    reassigned_.push_back(false);
+    return names_.size() - 1;
+}
+
+void SymbolTable::use(sym_id id)
+{
+    if (!bound(id) && !used_[id]) {
+        used_[id] = true;
+        free_.push_back(id);
+    }
+}
+
+nlist<std::string_view> SymbolTable::take_free()
+{
+    std::vector<std::string_view> names;
+
+    for (sym_id id : free_) {
+        used_[id] = false;
+        names.push_back(names_[id]);
+    }
+
+    free_.clear();
+    std::sort(names.begin(), names.end());
+    return arena_.list(names);
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "arena.h"
+#include "diagnostic.h"
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+typedef unsigned sym_id;
+
+/* interns symbol names as dense integer ids and tracks which symbols are bound in the current scope
+ * and which ones are used without being bound */
+class SymbolTable
+{
+  private:
+    Arena &arena_;
+    std::unordered_map<std::string_view, sym_id> ids_;
+    std::vector<std::string_view> names_;
+    std::vector<unsigned> bindings_;
+    std::vector<bool> used_;
+    std::vector<bool> reassigned_;
+    std::vector<sym_id> free_;
+
+  public:
+    static const sym_id NONE = ~0u;
+
+    /* problems found while resolving that do not stop the compilation */
+    std::vector<cinja::diagnostic> warnings;
+
+    /* names are copied into the arena */
+    explicit SymbolTable(Arena &arena) : arena_(arena) {}
+
+    SymbolTable(const SymbolTable &) = delete;
+    SymbolTable &operator=(const SymbolTable &) = delete;
+
+    sym_id intern(std::string_view name);
+    std::string_view name(sym_id id) const { return names_[id]; }
+    size_t size() const { return names_.size(); }
+
+    /* bindings nest, a symbol stays bound until every bind has been undone */
+    void bind(sym_id id) { ++bindings_[id]; }
+    void unbind(sym_id id) { --bindings_[id]; }
+    bool bound(sym_id id) const { return bindings_[id] > 0; }
+
+    /* records a use of the symbol, which is free if it is not bound */
+    void use(sym_id id);
+
+    /* records an assignment to a bound symbol, the values of such symbols change over time */
+    void reassign(sym_id id) { reassigned_[id] = true; }
+    bool reassigned(sym_id id) const { return reassigned_[id]; }
+
+    /* returns the free symbols used since the last call ordered by name and forgets them */
+    nlist<std::string_view> take_free();
+};
@@ -1,4 +1,20 @@
 #include "token.h"
+#include <cstdlib>
+
+/* zero initialized before any type is constructed */
+static const tk_type *types_[tk_type::MAX_TYPES];
+static unsigned num_types_;
+
+uint8_t tk_type::register_type(const tk_type *type)
+{
+    if (num_types_ == MAX_TYPES)
+        abort();
+
+    types_[num_types_] = type;
+    return num_types_++;
+}
+
+const tk_type *tk_type::from_id(uint8_t id) { return types_[id]; }
 
 static const tk_type EOI_("END_OF_INPUT");
 const tk_type_ptr tk_types::EOI = &EOI_;
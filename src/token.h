@@ -1,26 +1,40 @@
 #pragma once
-#include <regex>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
 
 class tk_type
 {
   private:
     std::string name_;
-    std::regex regexp_;
+    const char *regexp_;
+    uint8_t id_;
+
+    static uint8_t register_type(const tk_type *type);
 
   public:
-    explicit tk_type() : name_("UNKNOWN"){};
+    /* every type gets a small id when it is constructed during static initialization */
+    static const unsigned MAX_TYPES = 256;
+
+    explicit tk_type() : name_("UNKNOWN"), regexp_(""), id_(register_type(this)){};
 
-    explicit tk_type(const std::string &name) : name_(name){};
+    explicit tk_type(const std::string &name)
+        : name_(name), regexp_(""), id_(register_type(this)){};
 
-    explicit tk_type(const std::string &name, const std::string &regexp)
-        : name_(name),
-          regexp_(regexp, std::regex_constants::nosubs | std::regex_constants::optimize){};
+    /* the regular expression is only compiled at build time, see dfagen.cpp */
+    explicit tk_type(const std::string &name, const char *regexp)
+        : name_(name), regexp_(regexp), id_(register_type(this)){};
 
     tk_type(const tk_type &) = delete;
     tk_type &operator=(const tk_type &) = delete;
 
     const std::string &name() const { return name_; }
-    const std::regex &regexp() const { return regexp_; }
+    const char *regexp() const { return regexp_; }
+    uint8_t id() const { return id_; }
+
+    static const tk_type *from_id(uint8_t id);
 };
 
 typedef const tk_type *tk_type_ptr;
@@ -35,24 +49,82 @@ class tk
 {
   private:
     tk_type_ptr type_;
-    std::string value_;
+    std::string_view value_;
     long start_line_;
-    long num_lines_;
 
   public:
-    tk() : type_(tk_types::UNKNOWN), start_line_(0), num_lines_(0){};
+    tk() : type_(tk_types::UNKNOWN), start_line_(0){};
 
-    tk(tk_type_ptr type, const std::string &value, const long start_line)
-        : type_(type), value_(value), start_line_(start_line),
-          num_lines_(std::count(value.begin(), value.end(), '\n')){};
+    /* the value refers to the template source, which has to outlive the token */
+    tk(tk_type_ptr type, std::string_view value, const long start_line)
+        : type_(type), value_(value), start_line_(start_line){};
 
     tk_type_ptr type() const { return type_; }
     const long start_line() const { return start_line_; }
-    const long num_lines() const { return num_lines_; }
-    const std::string &value() const { return value_; }
+    std::string_view value() const { return value_; }
 };
 
 std::ostream &operator<<(std::ostream &o, const tk &b);
 
 typedef std::vector<tk_type_ptr> tk_type_vec;
-typedef std::vector<tk> tk_vec;
+
+/* a sequence of tokens that is read in order */
+class tk_source
+{
+  public:
+    /* returns the token at position i or an END_OF_INPUT token past the end */
+    virtual tk at(size_t i) = 0;
+    virtual ~tk_source() {}
+};
+
+/* a compact sequence of tokens that keeps their fields in parallel arrays, values are stored as
+ * offsets into the template source, which is therefore limited to 4GB */
+class tk_store : public tk_source
+{
+  private:
+    std::string_view source_;
+    std::vector<uint8_t> types_;
+    std::vector<uint32_t> offsets_;
+    std::vector<uint32_t> lengths_;
+    std::vector<uint32_t> lines_;
+
+  public:
+    explicit tk_store(std::string_view source) : source_(source) {}
+
+    void push_back(tk_type_ptr type, size_t offset, size_t length, long line)
+    {
+        types_.push_back(type->id());
+        offsets_.push_back(offset);
+        lengths_.push_back(length);
+        lines_.push_back(line);
+    }
+
+    void reserve(size_t size)
+    {
+        types_.reserve(size);
+        offsets_.reserve(size);
+        lengths_.reserve(size);
+        lines_.reserve(size);
+    }
+
+    void append(const tk_store &other)
+    {
+        types_.insert(types_.end(), other.types_.begin(), other.types_.end());
+        offsets_.insert(offsets_.end(), other.offsets_.begin(), other.offsets_.end());
+        lengths_.insert(lengths_.end(), other.lengths_.begin(), other.lengths_.end());
+        lines_.insert(lines_.end(), other.lines_.begin(), other.lines_.end());
+    }
+
+    size_t size() const { return types_.size(); }
+    bool empty() const { return types_.empty(); }
+    std::string_view source() const { return source_; }
+
+    tk_type_ptr type(size_t i) const { return tk_type::from_id(types_[i]); }
+
+    tk operator[](size_t i) const
+    {
+        return tk(type(i), source_.substr(offsets_[i], lengths_[i]), lines_[i]);
+    }
+
+    tk at(size_t i) override { return i < size() ? (*this)[i] : tk(tk_types::EOI, "", 0); }
+};
@@ -9,15 +9,15 @@
 
 #include "tokens.h"
 
-const tk_type_vec BLOCK_TOKENS{tk_types::CODE_BLOCK, tk_types::VAR_BLOCK, tk_types::CONTENT};
-
 const tk_type_vec CODE_TOKENS{
-    tk_types::FOR,        tk_types::ENDFOR, tk_types::IN,     tk_types::IF,
-    tk_types::FILTER,     tk_types::ENDIF,  tk_types::ELIF,   tk_types::ELSE,
-    tk_types::NOT,        tk_types::TRUE,   tk_types::FALSE,  tk_types::COMMA,
-    tk_types::OPENP,      tk_types::CLOSEP, tk_types::OPENB,  tk_types::CLOSEB,
-    tk_types::BIN_OP,     tk_types::NUMBER, tk_types::STRING, tk_types::IDENTIFIER,
-    tk_types::ASSIGNMENT, tk_types::SET,    tk_types::MACRO,  tk_types::ENDMACRO};
+    tk_types::FOR,        tk_types::ENDFOR,     tk_types::IN,     tk_types::AS,
+    tk_types::IF,         tk_types::FILTER,     tk_types::ENDIF,  tk_types::ELIF,
+    tk_types::ELSE,       tk_types::NOT,        tk_types::TRUE,   tk_types::FALSE,
+    tk_types::COMMA,      tk_types::OPENP,      tk_types::CLOSEP, tk_types::OPENB,
+    tk_types::CLOSEB,     tk_types::BIN_OP,     tk_types::NUMBER, tk_types::STRING,
+    tk_types::IDENTIFIER, tk_types::ASSIGNMENT, tk_types::SET,    tk_types::MACRO,
+    tk_types::ENDMACRO,   tk_types::EXTENDS,    tk_types::BLOCK,  tk_types::ENDBLOCK,
+    tk_types::INCLUDE,    tk_types::IMPORT};
 
 const tk_type_vec CODE_DELIMITER{tk_types::CODE_END, tk_types::WS};
 
@@ -44,10 +44,15 @@ DEFINE_TOKEN(SET, "\\{%" "\\s*" "set");
 DEFINE_TOKEN(ASSIGNMENT, "=");
 DEFINE_TOKEN(MACRO, "\\{%" "\\s*" "macro");
 DEFINE_TOKEN(ENDMACRO, "\\{%" "\\s*" "endmacro");
+DEFINE_TOKEN(EXTENDS, "\\{%" "\\s*" "extends");
+DEFINE_TOKEN(BLOCK, "\\{%" "\\s*" "block");
+DEFINE_TOKEN(ENDBLOCK, "\\{%" "\\s*" "endblock");
+DEFINE_TOKEN(INCLUDE, "\\{%" "\\s*" "include");
+DEFINE_TOKEN(IMPORT, "\\{%" "\\s*" "import");
+DEFINE_TOKEN(AS, "as");
 
 /* clang-format on */
 
-extern const tk_type_vec BLOCK_TOKENS;
 extern const tk_type_vec CODE_TOKENS;
 extern const tk_type_vec VAR_TOKENS;
 extern const tk_type_vec CODE_DELIMITER;
@@ -1,8 +1,10 @@
 #include "validate.h"
 #include <cxxabi.h>
+#include <memory>
 #include <sstream>
+#include <stdexcept>
 
-static std::string demangle(const char *name)
+std::string demangle(const char *name)
 {
     int status = -1;
     std::unique_ptr<char, void (*)(void *)> res{abi::__cxa_demangle(name, NULL, NULL, &status),
@@ -13,6 +15,8 @@ static std::string demangle(const char *name)
 
 InvalidTypeException::InvalidTypeException(const ExprNode &node, const std::type_index &type)
 {
+    line_ = node.begin_line() + 1;
+
     std::stringstream s;
     s << "expression '";
     node.print(s) << "' on";
@@ -55,7 +59,7 @@ void UnOpNode::match_type(const std::type_index &arg, const std::type_index &typ
         throw InvalidTypeException(*this->arg, type);
 }
 
-std::type_index UnOpNode::type() const
+std::type_index UnOpNode::infer_type() const
 {
     auto arg = this->arg->type();
 
@@ -72,7 +76,7 @@ std::type_index UnOpNode::type() const
         return typeid(bool);
     }
 
-    throw InvalidTypeException(*this, IdentifierType);
+    throw std::logic_error("unknown operator");
 }
 
 void BinOpNode::validate() const { type(); }
@@ -87,8 +91,18 @@ void BinOpNode::match_types(const std::type_index &lhs, const std::type_index &r
         throw InvalidTypeException(*this->rhs, type);
 }
 
-std::type_index BinOpNode::type() const
+std::type_index BinOpNode::infer_type() const
 {
+    /* the operators of a chain are typed from the innermost one, so that each of them finds the
+     * type of its left operand in the cache */
+    std::vector<const BinOpNode *> untyped;
+    for (auto op = dynamic_cast<const BinOpNode *>(this->lhs); op && !op->typed();
+         op = dynamic_cast<const BinOpNode *>(op->lhs))
+        untyped.push_back(op);
+
+    for (auto op = untyped.rbegin(); op != untyped.rend(); ++op)
+        (*op)->type();
+
     auto lhs = this->lhs->type();
     auto rhs = this->rhs->type();
 
@@ -102,8 +116,8 @@ std::type_index BinOpNode::type() const
     case BinOp::NEQ:
         if (lhs == typeid(bool) || rhs == typeid(bool))
             match_types(lhs, rhs, typeid(bool));
-        else if (lhs == typeid(std::string) || rhs == typeid(std::string))
-            match_types(lhs, rhs, typeid(std::string));
+        else if (lhs == typeid(std::string_view) || rhs == typeid(std::string_view))
+            match_types(lhs, rhs, typeid(std::string_view));
         else
             match_types(lhs, rhs, typeid(double));
         return typeid(bool);
@@ -112,8 +126,8 @@ std::type_index BinOpNode::type() const
     case BinOp::GE:
     case BinOp::LT:
     case BinOp::LE:
-        if (lhs == typeid(std::string) || rhs == typeid(std::string))
-            match_types(lhs, rhs, typeid(std::string));
+        if (lhs == typeid(std::string_view) || rhs == typeid(std::string_view))
+            match_types(lhs, rhs, typeid(std::string_view));
         else
             match_types(lhs, rhs, typeid(double));
         return typeid(bool);
@@ -128,13 +142,13 @@ std::type_index BinOpNode::type() const
     case BinOp::DOT:
     case BinOp::ARROW:
         if (lhs != IdentifierType)
-            throw InvalidTypeException(*this, IdentifierType);
+            throw InvalidTypeException(*this->lhs, IdentifierType);
         if (rhs != FieldType)
-            throw InvalidTypeException(*this, FieldType);
+            throw InvalidTypeException(*this->rhs, FieldType);
         return IdentifierType;
     }
 
-    throw InvalidTypeException(*this, IdentifierType);
+    throw std::logic_error("unknown operator");
 }
 
 void StmtListNode::validate() const
@@ -143,8 +157,8 @@ void StmtListNode::validate() const
         stmt->validate();
 }
 
-std::type_index FieldNode::type() const { return FieldType; }
-std::type_index IdNode::type() const { return IdentifierType; }
+std::type_index FieldNode::infer_type() const { return FieldType; }
+std::type_index IdNode::infer_type() const { return IdentifierType; }
 
 void ForNode::validate() const
 {
@@ -166,7 +180,7 @@ void SetNode::validate() const
 
 void ListNode::validate() const { type(); }
 
-std::type_index ListNode::type() const
+std::type_index ListNode::infer_type() const
 {
     if (values.size() < 2)
         return ListType;
@@ -213,8 +227,17 @@ void CallNode::validate() const
         value->validate();
 }
 
+void ImportNode::validate() const
+{
+    for (const auto &macro : macros)
+        macro->validate();
+}
+
 void TemplateNode::validate() const
 {
+    for (const auto &import : imports)
+        import->validate();
+
     for (const auto &macro : macros)
         macro->validate();
 
@@ -1,11 +1,11 @@
 #include "ast.h"
+#include "diagnostic.h"
 
-class InvalidTypeException : public std::exception
-{
-  private:
-    std::string what_;
+/* returns the readable name of a type as returned by std::type_info::name() */
+std::string demangle(const char *name);
 
+class InvalidTypeException : public CompileError
+{
   public:
     InvalidTypeException(const ExprNode &node, const std::type_index &type);
-    const char *what() const noexcept override { return what_.c_str(); }
 };
@@ -0,0 +1,166 @@
+# generates a pathological template of the given SHAPE in two sizes, n and 4n, and compiles them on
+# a 1 MB stack, the compilation has to succeed, or fail with ERROR for the shapes beyond the limits
+# of the parser, the peak resident set has to stay below MAX_RSS_KB and the time and the peak
+# resident set have to grow at most linearly with n
+
+# sets text to the template of the shape with n units of its pathology
+function(generate n)
+    set(text "")
+
+    if(SHAPE STREQUAL "no_tags")
+        math(EXPR lines "${n} * 27500")
+        string(REPEAT "lorem ipsum dolor sit amet, <p>consectetur</p>\n" ${lines} text)
+    elseif(SHAPE STREQUAL "many_tags")
+        math(EXPR lines "${n} * 20000")
+        string(REPEAT "<li>{{ a.name }}</li>{% if a.ok %}<b>{{ a.v * 2 }}</b>{% endif %}\n"
+               ${lines} text)
+    elseif(SHAPE STREQUAL "chain")
+        math(EXPR terms "${n} * 200000")
+        string(REPEAT "a + " ${terms} chain)
+        set(text "{{ ${chain}a }}")
+    elseif(SHAPE STREQUAL "or_chain")
+        # appended in blocks, the text is copied on every append
+        set(text "{% if x")
+        math(EXPR blocks "${n} * 20 - 1")
+        foreach(i RANGE ${blocks})
+            set(block "")
+            foreach(j RANGE 999)
+                string(APPEND block " or x${i}_${j}")
+            endforeach()
+            string(APPEND text "${block}")
+        endforeach()
+        string(APPEND text " %}y{% endif %}")
+    elseif(SHAPE STREQUAL "literal_chain")
+        math(EXPR terms "${n} * 20000")
+        string(REPEAT "1 + " ${terms} ints)
+        string(REPEAT "false or " ${terms} bools)
+        set(text "{{ ${ints}1 }}{% if ${bools}x %}y{% endif %}")
+    elseif(SHAPE STREQUAL "nested")
+        math(EXPR depth "${n} * 50")
+        string(REPEAT "{% for i in x if i.n > 1 %}{% if i.v %}" ${depth} open)
+        string(REPEAT "{% endif %}{% endfor %}" ${depth} close)
+        set(text "${open}{{ i.v + 1 }}${close}")
+    elseif(SHAPE STREQUAL "parens")
+        math(EXPR depth "${n} * 100")
+        string(REPEAT "(" ${depth} open)
+        string(REPEAT ")" ${depth} close)
+        set(text "{{ ${open}a + 1${close} }}{{ ${open}-a${close} }}")
+    elseif(SHAPE STREQUAL "too_deep")
+        math(EXPR depth "${n} * 20000")
+        string(REPEAT "(" ${depth} open)
+        string(REPEAT ")" ${depth} close)
+        set(text "{{ ${open}a${close} }}")
+    elseif(SHAPE STREQUAL "unswitch")
+        foreach(i RANGE 15)
+            string(APPEND loops "{% for x${i} in l${i} %}{% if c${i} %}${i}{% endif %}")
+        endforeach()
+        string(REPEAT "{% endfor %}" 16 close)
+        math(EXPR count "${n} * 200")
+        string(REPEAT "${loops}{{ x0 }}${close}\n" ${count} text)
+    elseif(SHAPE STREQUAL "unroll")
+        string(REPEAT "{% for x in [1, 2, 3, 4, 5, 6, 7, 8] %}" 7 open)
+        string(REPEAT "{% endfor %}" 7 close)
+        string(REPEAT "${open}{{ n }}${close}\n" ${n} text)
+    elseif(SHAPE STREQUAL "macro_chain")
+        set(text "{% macro m0(x) %}<{{ x }}>{% endmacro %}")
+        math(EXPR levels "${n} * 10")
+        foreach(i RANGE 1 ${levels})
+            math(EXPR callee "${i} - 1")
+            string(REPEAT "{{ m${callee}(x) }}" 8 calls)
+            string(APPEND text "{% macro m${i}(x) %}${calls}{% endmacro %}")
+        endforeach()
+        string(APPEND text "{{ m${levels}(y) }}")
+    else()
+        message(FATAL_ERROR "unknown shape ${SHAPE}")
+    endif()
+
+    set(text "${text}" PARENT_SCOPE)
+endfunction()
+
+# compiles the template on a 1 MB stack, without the statistics, which need all tokens in memory,
+# to time the streaming lexer of a regular compilation, and with them for the peak resident set
+function(compile template)
+    set(command sh -c "ulimit -s 1024 && exec \"$0\" \"$@\"" ${CINJA})
+
+    string(TIMESTAMP start "%s%f")
+    execute_process(COMMAND ${command} -o ${template}.h ${template}
+                    RESULT_VARIABLE status ERROR_VARIABLE errors)
+    string(TIMESTAMP end "%s%f")
+    math(EXPR micros "${end} - ${start}")
+
+    if(ERROR)
+        if(status EQUAL 0 OR NOT errors MATCHES "${ERROR}")
+            message(FATAL_ERROR "expected the error '${ERROR}', got ${status}:\n${errors}")
+        endif()
+        return()
+    endif()
+
+    if(NOT status EQUAL 0)
+        message(FATAL_ERROR "cinja failed with ${status}:\n${errors}")
+    endif()
+
+    if(MAX_CODE_SIZE)
+        file(SIZE ${template}.h size)
+        if(size GREATER MAX_CODE_SIZE)
+            message(FATAL_ERROR "the code is ${size} bytes, more than ${MAX_CODE_SIZE} bytes")
+        endif()
+    endif()
+
+    execute_process(COMMAND ${command} --stats=json -o ${template}.h ${template}
+                    RESULT_VARIABLE status ERROR_VARIABLE stats)
+    if(NOT status EQUAL 0)
+        message(FATAL_ERROR "cinja --stats failed with ${status}:\n${stats}")
+    endif()
+
+    set(peak 0)
+    string(REGEX MATCHALL "\"peak_rss_kb\": [0-9]+" phases "${stats}")
+    foreach(phase ${phases})
+        string(REGEX REPLACE ".* " "" rss "${phase}")
+        if(rss GREATER peak)
+            set(peak ${rss})
+        endif()
+    endforeach()
+
+    if(peak GREATER MAX_RSS_KB)
+        message(FATAL_ERROR "the peak resident set is ${peak} KiB, more than ${MAX_RSS_KB} KiB")
+    endif()
+
+    set(micros ${micros} PARENT_SCOPE)
+    set(peak ${peak} PARENT_SCOPE)
+endfunction()
+
+if(SHAPE STREQUAL "too_deep")
+    set(ERROR "nesting deeper than")
+elseif(SHAPE STREQUAL "unroll")
+    # unrolling is bounded by the budget of the outermost loop, not by that of each one
+    set(MAX_CODE_SIZE 262144)
+endif()
+
+foreach(n 1 4)
+    generate(${n})
+    file(WRITE ${WORK}/${SHAPE}_${n}.html "${text}")
+    compile(${WORK}/${SHAPE}_${n}.html)
+    set(micros_${n} ${micros})
+    set(peak_${n} ${peak})
+endforeach()
+
+if(ERROR)
+    return()
+endif()
+
+# four times the input may take eight times as long and six times the memory, which leaves room
+# for noise and for the memory of the process itself, a quadratic pass takes sixteen times, the
+# time of small templates is dominated by starting the process and gets 50 ms of slack
+math(EXPR max_micros "${micros_1} * 8 + 50000")
+math(EXPR max_peak "${peak_1} * 6")
+
+if(micros_4 GREATER max_micros)
+    message(FATAL_ERROR "the time grows from ${micros_1} us to ${micros_4} us for 4 times the size")
+endif()
+
+if(peak_4 GREATER max_peak)
+    message(FATAL_ERROR "the peak resident set grows from ${peak_1} KiB to ${peak_4} KiB for "
+                        "4 times the size")
+endif()
+
+message(STATUS "${SHAPE}: ${micros_1} us, ${peak_1} KiB for n, ${micros_4} us, ${peak_4} KiB for 4n")
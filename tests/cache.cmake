@@ -0,0 +1,37 @@
+# compiles the same template in two directories with the same cache, each one has to extend the
+# base template of its own directory
+set(dir ${WORK}/cache)
+file(REMOVE_RECURSE ${dir})
+file(MAKE_DIRECTORY ${dir}/cache)
+
+foreach(base ONE TWO)
+    file(WRITE ${dir}/${base}/page.html
+         "{% extends \"base.html\" %}{% block b %}child{% endblock %}")
+    file(WRITE ${dir}/${base}/base.html "${base}{% block b %}{% endblock %}")
+endforeach()
+
+foreach(base ONE TWO)
+    execute_process(COMMAND ${CINJA} --cache=${dir}/cache -o ${dir}/${base}.h
+                            -MF ${dir}/${base}.d ${dir}/${base}/page.html
+                    RESULT_VARIABLE status)
+    if(NOT status EQUAL 0)
+        message(FATAL_ERROR "cinja failed: ${status}")
+    endif()
+
+    file(READ ${dir}/${base}.h code)
+    file(READ ${dir}/${base}.d deps)
+    if(NOT code MATCHES "${base}" OR NOT deps MATCHES "${base}/base.html")
+        message(FATAL_ERROR "${base}/page.html was compiled with the wrong base template")
+    endif()
+endforeach()
+
+# the warnings of a template are reported again when its code comes from the cache
+file(WRITE ${dir}/warns.html "{% macro m(x) %}{{ q }}{% endmacro %}{{ m(n) }}")
+
+foreach(build first cached)
+    execute_process(COMMAND ${CINJA} --cache=${dir}/cache -o ${dir}/warns.h ${dir}/warns.html
+                    RESULT_VARIABLE status ERROR_VARIABLE warnings)
+    if(NOT status EQUAL 0 OR NOT warnings MATCHES "Unknown symbol 'vsym_q' in macro 'm'")
+        message(FATAL_ERROR "the ${build} build reported ${status}:\n${warnings}")
+    endif()
+endforeach()
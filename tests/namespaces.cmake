@@ -0,0 +1,48 @@
+# compiles templates that import the same macros, one of them assigns to a variable that the
+# macros declare, so the macros are folded differently, the namespaces of the macros must have
+# the same name exactly if their code is the same
+set(dir ${WORK}/namespaces)
+file(REMOVE_RECURSE ${dir})
+
+file(WRITE ${dir}/lib.html "{% macro m(x) %}{% set y = 2 %}{{ y * x }}{% endmacro %}"
+                           "{% macro k(x) %}[{{ m(x) }}]{% endmacro %}")
+file(WRITE ${dir}/assigns.html "{% import \"lib.html\" as l %}{% set y = 1 %}"
+                               "{% for i in v %}{% set y = i %}{% endfor %}{{ l.k(y) }}")
+file(WRITE ${dir}/plain.html "{% import \"lib.html\" as l %}{{ l.k(n) }}")
+file(WRITE ${dir}/other.html "{% import \"lib.html\" as l %}{{ l.m(n) }}{{ l.k(2) }}")
+
+foreach(template assigns plain other)
+    execute_process(COMMAND ${CINJA} -o ${dir}/${template}.h ${dir}/${template}.html
+                    RESULT_VARIABLE status)
+    if(NOT status EQUAL 0)
+        message(FATAL_ERROR "cinja failed: ${status}")
+    endif()
+
+    file(READ ${dir}/${template}.h code)
+    if(NOT code MATCHES "namespace (macros_[0-9a-f]+) {[^#]*")
+        message(FATAL_ERROR "${template}.h has no namespace of imported macros")
+    endif()
+
+    set(name_${template} ${CMAKE_MATCH_1})
+    string(REPLACE "${CMAKE_MATCH_1}" "" code_${template} "${CMAKE_MATCH_0}")
+endforeach()
+
+foreach(pair assigns:plain plain:other assigns:other)
+    string(REPLACE ":" ";" pair ${pair})
+    list(GET pair 0 a)
+    list(GET pair 1 b)
+
+    set(same_name NO)
+    set(same_code NO)
+    if(name_${a} STREQUAL name_${b})
+        set(same_name YES)
+    endif()
+    if(code_${a} STREQUAL code_${b})
+        set(same_code YES)
+    endif()
+
+    if(NOT same_name STREQUAL same_code)
+        message(FATAL_ERROR "the macros of ${a} and ${b} are in ${name_${a}} and ${name_${b}}, "
+                            "the same code: ${same_code}")
+    endif()
+endforeach()
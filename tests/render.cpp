@@ -0,0 +1,10 @@
+/* renders a test template to stdout, the build picks the generated header, every test template
+ * takes the number n */
+#include TEMPLATE_HEADER
+#include <iostream>
+
+int main()
+{
+    render_template(std::cout, 7);
+    return 0;
+}
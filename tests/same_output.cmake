@@ -0,0 +1,16 @@
+# runs the renderers of one template, the ones in OPTIMIZED have to write what PLAIN writes
+execute_process(COMMAND ${PLAIN} OUTPUT_VARIABLE expected RESULT_VARIABLE status)
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "${PLAIN} failed: ${status}")
+endif()
+
+foreach(renderer ${OPTIMIZED})
+    execute_process(COMMAND ${renderer} OUTPUT_VARIABLE actual RESULT_VARIABLE status)
+    if(NOT status EQUAL 0)
+        message(FATAL_ERROR "${renderer} failed: ${status}")
+    endif()
+
+    if(NOT actual STREQUAL expected)
+        message(FATAL_ERROR "${renderer} wrote\n${actual}\ninstead of\n${expected}")
+    endif()
+endforeach()
@@ -0,0 +1,42 @@
+# compiles templates with and without variables to a header and a .cpp file for std::ostream,
+# builds the .cpp files and a program that includes the headers and links them, and runs it
+set(dir ${WORK}/sink)
+file(REMOVE_RECURSE ${dir})
+
+file(WRITE ${dir}/none.html "static")
+file(WRITE ${dir}/vars.html "{% for i in v %}{{ i * n }},{% endfor %}{{ n }}")
+
+set(none_args)
+set(vars_args --param=n=int --param=v=std::vector<int> --include=<vector>)
+
+foreach(template none vars)
+    execute_process(COMMAND ${CINJA} --sink=std::ostream --include=<ostream> ${${template}_args}
+                            -o ${dir}/${template}.h ${dir}/${template}.html
+                    RESULT_VARIABLE status)
+    if(NOT status EQUAL 0)
+        message(FATAL_ERROR "cinja failed for ${template}.html: ${status}")
+    endif()
+endforeach()
+
+# each header declares render_template, the declarations for both templates would clash, so
+# every template gets a program of its own
+file(WRITE ${dir}/none_main.cpp "#include \"none.h\"\n#include <iostream>\n"
+                                "int main() { render_template(std::cout); }\n")
+file(WRITE ${dir}/vars_main.cpp "#include \"vars.h\"\n#include <iostream>\n"
+                                "int main() { render_template(std::cout, 3, {1, 2}); }\n")
+set(none_output "static")
+set(vars_output "3,6,3")
+
+foreach(template none vars)
+    execute_process(COMMAND ${CXX} -std=c++17 -o ${dir}/${template}
+                            ${dir}/${template}_main.cpp ${dir}/${template}.cpp
+                    RESULT_VARIABLE status ERROR_VARIABLE errors)
+    if(NOT status EQUAL 0)
+        message(FATAL_ERROR "the code of ${template}.html does not build:\n${errors}")
+    endif()
+
+    execute_process(COMMAND ${dir}/${template} RESULT_VARIABLE status OUTPUT_VARIABLE output)
+    if(NOT status EQUAL 0 OR NOT output STREQUAL ${template}_output)
+        message(FATAL_ERROR "${template} printed '${output}' instead of '${${template}_output}'")
+    endif()
+endforeach()